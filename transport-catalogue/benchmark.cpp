@@ -0,0 +1,650 @@
+// Бенчмарк масштабируемости справочника на синтетических городах.
+// Генерирует детерминированную сеть остановок и маршрутов нескольких размеров и замеряет
+// разбор JSON, загрузку справочника, построение графа и маршрутизатора, запросы и отрисовку карты.
+//
+// Использование:
+//   benchmark [--sizes 100,1000,10000,100000] [--stops-per-bus K] [--bus-ratio R] [--roundtrip-ratio R]
+//             [--distance-density D] [--queries N] [--router-max-stops N] [--seed S] [--perf-counters]
+
+#include "format.h"
+#include "json.h"
+#include "json_reader.h"
+#include "map_disk_cache.h"
+#include "map_renderer.h"
+#include "perf_counters.h"
+#include "profiler.h"
+#include "transport_catalogue.h"
+#include "transport_router.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+using namespace std::literals;
+
+struct GeneratorSettings {
+    size_t stops = 1000;
+    // Число маршрутов на одну остановку
+    double bus_ratio = 0.1;
+    size_t stops_per_bus = 12;
+    // Доля кольцевых маршрутов
+    double roundtrip_ratio = 0.5;
+    // Число дополнительных road_distances у каждой остановки сверх расстояний между соседями по маршрутам
+    size_t distance_density = 2;
+    uint64_t seed = 1;
+};
+
+struct BenchmarkSettings {
+    std::vector<size_t> sizes = {100, 1000, 10000, 100000};
+    GeneratorSettings generator;
+    size_t queries = 10000;
+    // Маршрутизатор хранит матрицу всех пар вершин, поэтому для крупных сетей его построение пропускается
+    size_t router_max_stops = 1000;
+    // Замерять аппаратные счётчики процессора
+    bool perf_counters = false;
+};
+
+/*
+ * Генератор синтетического города. Остановки расставлены по сетке со случайным смещением,
+ * маршруты идут случайным блужданием по соседним клеткам сетки.
+ * Использует только mt19937_64 и собственные распределения, поэтому результат одинаков на всех платформах
+ */
+class CityGenerator {
+public:
+    explicit CityGenerator(const GeneratorSettings& settings)
+        : settings_(settings)
+        , random_(settings.seed)
+        , side_(std::max<size_t>(1, static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(settings.stops)))))) {
+    }
+
+    // Возвращает входной документ без stat_requests
+    std::string Generate() {
+        PlaceStops();
+        BuildBuses();
+        AddExtraDistances();
+
+        std::string text;
+        format::Writer out(text);
+        out << "{\"base_requests\": ["sv;
+        for (size_t i = 0; i < stops_.size(); ++i) {
+            const GeneratedStop& stop = stops_[i];
+            out << (i == 0 ? "\n"sv : ",\n"sv) << "{\"type\": \"Stop\", \"name\": \""sv << StopName(i)
+                << "\", \"latitude\": "sv;
+            out.WriteDouble(stop.coordinates.lat, 9);
+            out << ", \"longitude\": "sv;
+            out.WriteDouble(stop.coordinates.lng, 9);
+            out << ", \"road_distances\": {"sv;
+            bool first = true;
+            for (const auto& [to, distance] : stop.road_distances) {
+                out << (first ? ""sv : ", "sv) << '"' << StopName(to) << "\": "sv << distance;
+                first = false;
+            }
+            out << "}}"sv;
+        }
+        for (size_t i = 0; i < buses_.size(); ++i) {
+            const GeneratedBus& bus = buses_[i];
+            out << ",\n{\"type\": \"Bus\", \"name\": \"Bus "sv << i << "\", \"stops\": ["sv;
+            for (size_t j = 0; j < bus.stops.size(); ++j) {
+                out << (j == 0 ? "\""sv : ", \""sv) << StopName(bus.stops[j]) << '"';
+            }
+            out << "], \"is_roundtrip\": "sv << (bus.is_roundtrip ? "true"sv : "false"sv) << '}';
+        }
+        out << "\n],\n\"render_settings\": {\"width\": 1200, \"height\": 1200, \"padding\": 50, \"line_width\": 14,"
+               " \"stop_radius\": 5, \"bus_label_font_size\": 20, \"bus_label_offset\": [7, 15],"
+               " \"stop_label_font_size\": 20, \"stop_label_offset\": [7, -3], \"underlayer_color\": [255, 255, 255, 0.85],"
+               " \"underlayer_width\": 3, \"color_palette\": [\"green\", [255, 160, 0], \"red\"]},\n"
+               "\"routing_settings\": {\"bus_wait_time\": 6, \"bus_velocity\": 40},\n"
+               "\"stat_requests\": []}\n"sv;
+        out.Flush();
+        return text;
+    }
+
+    size_t GetBusCount() const {
+        return buses_.size();
+    }
+
+    static std::string StopName(size_t index) {
+        return "Stop " + std::to_string(index);
+    }
+
+    static std::string BusName(size_t index) {
+        return "Bus " + std::to_string(index);
+    }
+
+private:
+    // Шаг сетки около 300 метров
+    static constexpr double CELL_DEGREES = 0.003;
+
+    struct GeneratedStop {
+        geo::Coordinates coordinates;
+        std::map<size_t, int> road_distances;
+    };
+
+    struct GeneratedBus {
+        std::vector<size_t> stops;
+        bool is_roundtrip = false;
+    };
+
+    size_t NextIndex(size_t bound) {
+        return static_cast<size_t>(random_() % bound);
+    }
+
+    double NextDouble() {
+        return static_cast<double>(random_() >> 11) * 0x1.0p-53;
+    }
+
+    void PlaceStops() {
+        stops_.resize(settings_.stops);
+        for (size_t i = 0; i < stops_.size(); ++i) {
+            const double row = static_cast<double>(i / side_) + NextDouble() * 0.8;
+            const double column = static_cast<double>(i % side_) + NextDouble() * 0.8;
+            stops_[i].coordinates = {55.5 + row * CELL_DEGREES, 37.3 + column * CELL_DEGREES};
+        }
+    }
+
+    // Дорожное расстояние длиннее прямого на 10-50%
+    void AddDistance(size_t from, size_t to) {
+        if (from == to || stops_[from].road_distances.count(to) != 0) {
+            return;
+        }
+        const double direct = geo::ComputeDistance(stops_[from].coordinates, stops_[to].coordinates);
+        const int distance = std::max(1, static_cast<int>(direct * (1.1 + 0.4 * NextDouble())));
+        stops_[from].road_distances.emplace(to, distance);
+    }
+
+    // Случайная соседняя по сетке остановка
+    size_t NextStop(size_t stop) {
+        const size_t row = stop / side_;
+        const size_t column = stop % side_;
+        for (int attempt = 0; attempt < 8; ++attempt) {
+            const size_t direction = NextIndex(4);
+            size_t next_row = row;
+            size_t next_column = column;
+            if (direction == 0 && row > 0) {
+                --next_row;
+            } else if (direction == 1) {
+                ++next_row;
+            } else if (direction == 2 && column > 0) {
+                --next_column;
+            } else if (direction == 3) {
+                ++next_column;
+            }
+            const size_t next = next_row * side_ + next_column;
+            if (next_column < side_ && next < stops_.size() && next != stop) {
+                return next;
+            }
+        }
+        return NextIndex(stops_.size());
+    }
+
+    void BuildBuses() {
+        const size_t bus_count = std::max<size_t>(1, static_cast<size_t>(static_cast<double>(settings_.stops) * settings_.bus_ratio));
+        const size_t stops_per_bus = std::max<size_t>(2, settings_.stops_per_bus);
+        buses_.resize(bus_count);
+        for (GeneratedBus& bus : buses_) {
+            bus.is_roundtrip = NextDouble() < settings_.roundtrip_ratio;
+            bus.stops.push_back(NextIndex(stops_.size()));
+            while (bus.stops.size() < stops_per_bus) {
+                bus.stops.push_back(NextStop(bus.stops.back()));
+            }
+            if (bus.is_roundtrip) {
+                bus.stops.push_back(bus.stops.front());
+            }
+            for (size_t i = 0; i + 1 < bus.stops.size(); ++i) {
+                AddDistance(bus.stops[i], bus.stops[i + 1]);
+            }
+        }
+    }
+
+    void AddExtraDistances() {
+        for (size_t i = 0; i < stops_.size(); ++i) {
+            for (size_t j = 0; j < settings_.distance_density; ++j) {
+                AddDistance(i, NextStop(i));
+            }
+        }
+    }
+
+    const GeneratorSettings& settings_;
+    std::mt19937_64 random_;
+    size_t side_;
+    std::vector<GeneratedStop> stops_;
+    std::vector<GeneratedBus> buses_;
+};
+
+struct Measurement {
+    double wall_ms = 0.0;
+    uint64_t allocations = 0;
+    uint64_t allocated_bytes = 0;
+    perf_counters::Sample counters;
+};
+
+Measurement Measure(const std::function<void()>& kernel) {
+    std::optional<perf_counters::Counters> counters;
+    if (profiler::AreHardwareCountersEnabled()) {
+        counters.emplace();
+    }
+    const uint64_t allocations_start = profiler::GetAllocationCount();
+    const uint64_t allocated_bytes_start = profiler::GetAllocatedBytes();
+    const auto start = std::chrono::steady_clock::now();
+    if (counters) {
+        counters->Start();
+    }
+    kernel();
+    Measurement measurement;
+    if (counters) {
+        measurement.counters = counters->Stop();
+    }
+    const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    measurement.wall_ms = elapsed.count();
+    measurement.allocations = profiler::GetAllocationCount() - allocations_start;
+    measurement.allocated_bytes = profiler::GetAllocatedBytes() - allocated_bytes_start;
+    return measurement;
+}
+
+double PeakRssMb() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<double>(usage.ru_maxrss) / 1024.0;
+}
+
+double ToMb(uint64_t bytes) {
+    return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+
+// Строка отчёта: время, пропускная способность в единицах unit и выделения памяти
+void PrintRow(std::string_view name, const Measurement& measurement, double amount, std::string_view unit) {
+    std::cout << "  " << std::left << std::setw(24) << name << std::right
+              << std::setw(12) << std::fixed << std::setprecision(3) << measurement.wall_ms << " ms";
+    if (amount > 0.0 && measurement.wall_ms > 0.0) {
+        std::cout << std::setw(14) << std::setprecision(1) << amount / (measurement.wall_ms / 1000.0) << ' ' << unit;
+    } else {
+        std::cout << std::setw(14) << '-' << ' ' << unit;
+    }
+    std::cout << std::setw(12) << measurement.allocations << " allocs"
+              << std::setw(12) << std::setprecision(2) << ToMb(measurement.allocated_bytes) << " MB allocated";
+    const perf_counters::Sample& counters = measurement.counters;
+    if (const auto ipc = counters.GetIpc()) {
+        std::cout << "  IPC " << std::setprecision(2) << *ipc;
+    }
+    if (const auto mpki = counters.GetL1dMpki()) {
+        std::cout << "  L1D " << std::setprecision(2) << *mpki << " MPKI";
+    }
+    if (const auto mpki = counters.GetLlcMpki()) {
+        std::cout << "  LLC " << std::setprecision(2) << *mpki << " MPKI";
+    }
+    if (const auto miss_rate = counters.GetBranchMissRate()) {
+        std::cout << "  branch miss " << std::setprecision(2) << *miss_rate * 100.0 << '%';
+    }
+    std::cout << '\n';
+}
+
+// Последняя записанная профилировщиком фаза с именем name
+Measurement LastPhase(std::string_view name) {
+    const auto phases = profiler::GetPhases();
+    for (auto it = phases.rbegin(); it != phases.rend(); ++it) {
+        if (it->name == name) {
+            return {it->wall_ms, it->allocations, it->allocated_bytes, it->counters};
+        }
+    }
+    return {};
+}
+
+// Допуск упрощения ломаных для замера обзорной карты, в пикселях
+constexpr double SIMPLIFY_TOLERANCE = 1.0;
+
+void RunSize(const BenchmarkSettings& settings, size_t size) {
+    GeneratorSettings generator_settings = settings.generator;
+    generator_settings.stops = size;
+    CityGenerator generator(generator_settings);
+    const std::string text = generator.Generate();
+
+    std::cout << "stops: " << size << ", buses: " << generator.GetBusCount()
+              << ", input: " << std::fixed << std::setprecision(2) << ToMb(text.size()) << " MB\n";
+
+    std::optional<json::Document> doc;
+    const Measurement load_json = Measure([&] {
+        std::istringstream input(text);
+        profiler::ScopedSubsystem subsystem(profiler::Subsystem::JsonDom);
+        doc.emplace(json::Load(input));
+    });
+    PrintRow("json::Load", load_json, ToMb(text.size()), "MB/s");
+
+    const auto& root = doc->GetRoot().AsDict();
+    json_reader::JsonReader reader;
+    transport_catalogue::TransportCatalogue catalogue;
+    const Measurement load_catalogue = Measure([&] {
+        reader.LoadBaseRequests(root.at("base_requests").AsArray(), catalogue);
+    });
+    PrintRow("catalogue load", load_catalogue, static_cast<double>(root.at("base_requests").AsArray().size()), "req/s");
+
+    std::mt19937_64 random(settings.generator.seed);
+    const size_t bus_count = generator.GetBusCount();
+    std::vector<std::string> stop_names(settings.queries);
+    std::vector<std::string> bus_names(settings.queries);
+    for (size_t i = 0; i < settings.queries; ++i) {
+        stop_names[i] = CityGenerator::StopName(random() % size);
+        bus_names[i] = CityGenerator::BusName(random() % bus_count);
+    }
+
+    size_t checksum = 0;
+    const Measurement bus_info = Measure([&] {
+        for (const auto& name : bus_names) {
+            checksum += static_cast<size_t>(catalogue.GetBusInfo(name)->stops_count);
+        }
+    });
+    PrintRow("GetBusInfo", bus_info, static_cast<double>(settings.queries), "ops/s");
+
+    const Measurement buses_by_stop = Measure([&] {
+        for (const auto& name : stop_names) {
+            checksum += catalogue.GetBusesByStop(name).size();
+        }
+    });
+    PrintRow("GetBusesByStop", buses_by_stop, static_cast<double>(settings.queries), "ops/s");
+
+    if (size <= settings.router_max_stops) {
+        const auto& routing_settings = root.at("routing_settings").AsDict();
+        transport_catalogue::TransportRouter router(routing_settings.at("bus_wait_time").AsInt(),
+                                                    routing_settings.at("bus_velocity").AsDouble());
+        const Measurement build = Measure([&] {
+            router.BuildGraph(catalogue);
+        });
+        // BuildGraph записывает обе свои фазы в профилировщик
+        PrintRow("BuildGraph (graph)", LastPhase("router.build_graph"), 0.0, "");
+        PrintRow("BuildGraph (all pairs)", LastPhase("router.build_all_pairs"), 0.0, "");
+        PrintRow("BuildGraph total", build, 0.0, "");
+
+        const Measurement find_route = Measure([&] {
+            for (size_t i = 0; i < settings.queries; ++i) {
+                const auto route = router.FindRoute(stop_names[i], stop_names[settings.queries - 1 - i]);
+                checksum += route ? route->items.size() : 0;
+            }
+        });
+        PrintRow("FindRoute", find_route, static_cast<double>(settings.queries), "ops/s");
+    } else {
+        std::cout << "  BuildGraph, FindRoute      skipped: all-pairs router for " << size
+                  << " stops exceeds --router-max-stops " << settings.router_max_stops << '\n';
+    }
+
+    map_renderer::RenderSettings render_settings;
+    reader.ProcessRenderSettings(root.at("render_settings"), render_settings);
+    size_t svg_size = 0;
+    const Measurement render = Measure([&] {
+        map_renderer::MapRenderer renderer;
+        svg_size = renderer.RenderSvg(render_settings, catalogue).size();
+    });
+    PrintRow("RenderSvg", render, ToMb(svg_size), "MB/s");
+
+    // Тот же вывод без строки с картой: фрагменты только подсчитываются
+    size_t streamed_size = 0;
+    const Measurement render_stream = Measure([&] {
+        map_renderer::MapRenderer renderer;
+        renderer.RenderSvg(render_settings, catalogue, [&streamed_size](std::string_view chunk) {
+            streamed_size += chunk.size();
+        });
+    });
+    PrintRow("RenderSvg (stream)", render_stream, ToMb(streamed_size), "MB/s");
+
+    // Слои по умолчанию отрисовываются во всех ядрах; для сравнения - в одном потоке
+    const Measurement render_single = Measure([&] {
+        map_renderer::MapRenderer renderer(1);
+        renderer.RenderSvg(render_settings, catalogue, [](std::string_view) {});
+    });
+    PrintRow("RenderSvg (1 thread)", render_single, ToMb(streamed_size), "MB/s");
+
+    // Обзорная карта с упрощением ломаных; пропускная способность считается по исходному объёму SVG
+    map_renderer::RenderSettings simplified_settings = render_settings;
+    simplified_settings.simplify_tolerance = SIMPLIFY_TOLERANCE;
+    size_t simplified_size = 0;
+    const Measurement render_simplified = Measure([&] {
+        map_renderer::MapRenderer renderer;
+        renderer.RenderSvg(simplified_settings, catalogue, [&simplified_size](std::string_view chunk) {
+            simplified_size += chunk.size();
+        });
+    });
+    PrintRow("RenderSvg (simplified)", render_simplified, ToMb(streamed_size), "MB/s");
+    std::cout << "  simplified SVG: " << std::setprecision(1) << 100.0 * static_cast<double>(simplified_size) / static_cast<double>(streamed_size)
+              << "% of full size with " << SIMPLIFY_TOLERANCE << " px tolerance\n";
+
+    // Тёплый старт с кэшем карты на диске: хэш справочника и отображение готового файла в память вместо RenderSvg
+    char cache_directory[] = "/tmp/map_cache_XXXXXX";
+    if (mkdtemp(cache_directory) != nullptr) {
+        const map_disk_cache::MapDiskCache disk_cache(cache_directory);
+        auto map_json = std::make_shared<std::string>();
+        {
+            format::Writer writer(*map_json);
+            writer.Put('"');
+            map_renderer::MapRenderer renderer;
+            renderer.RenderSvg(render_settings, catalogue, [&writer](std::string_view chunk) {
+                writer.WriteJsonEscaped(chunk);
+            });
+            writer.Put('"');
+        }
+        // Место выделения маршрута не влияет на загрузку, поэтому карта делится перед закрывающим тегом
+        const std::string_view map_text = *map_json;
+        const size_t below_size = map_text.size() - "</svg>\""sv.size();
+        map_disk_cache::SplitMap split_map;
+        split_map.below = json::RawJson(map_json, map_text.substr(0, below_size));
+        split_map.above = std::make_shared<const json::RawJson>(map_json, map_text.substr(below_size));
+        disk_cache.Store({map_disk_cache::HashMapFormat(), map_disk_cache::HashCatalogue(catalogue), 0}, split_map);
+
+        size_t loaded_size = 0;
+        const Measurement load_cached = Measure([&] {
+            const auto cached = disk_cache.Load({map_disk_cache::HashMapFormat(), map_disk_cache::HashCatalogue(catalogue), 0});
+            loaded_size = cached ? cached->below.text.size() + cached->above->text.size() : 0;
+        });
+        PrintRow("MapDiskCache load", load_cached, ToMb(loaded_size), "MB/s");
+        checksum += loaded_size;
+        std::filesystem::remove_all(cache_directory);
+    }
+
+    std::shared_ptr<const map_renderer::MapLayout> map_layout;
+    const Measurement build_map_layout = Measure([&] {
+        profiler::ScopedSubsystem subsystem(profiler::Subsystem::MapIndex);
+        map_layout = std::make_shared<const map_renderer::MapLayout>(render_settings, catalogue);
+    });
+    PrintRow("MapLayout build", build_map_layout, 0.0, "");
+
+    // Карта по частям и её обновление после изменения одного маршрута: отрисовывается заново только он
+    std::shared_ptr<const map_renderer::MapPieces> map_pieces;
+    const Measurement render_pieces = Measure([&] {
+        map_renderer::MapRenderer renderer;
+        map_pieces = renderer.RenderPieces(*map_layout, nullptr);
+    });
+    PrintRow("RenderPieces", render_pieces, ToMb(streamed_size), "MB/s");
+
+    json::Array changed_requests = root.at("base_requests").AsArray();
+    const std::string changed_bus = CityGenerator::BusName(bus_count / 2);
+    for (auto& request : changed_requests) {
+        const auto& fields = request.AsDict();
+        if (fields.at("type").AsString() == "Bus" && fields.at("name").AsString() == changed_bus) {
+            json::Dict bus = fields;
+            json::Array stops = bus.at("stops").AsArray();
+            std::reverse(stops.begin(), stops.end());
+            bus["stops"] = json::Node(std::move(stops));
+            request = json::Node(std::move(bus));
+        }
+    }
+    transport_catalogue::TransportCatalogue changed_catalogue;
+    reader.LoadBaseRequests(changed_requests, changed_catalogue);
+    const map_renderer::MapLayout changed_layout(render_settings, changed_catalogue);
+    std::shared_ptr<const map_renderer::MapPieces> changed_pieces;
+    const Measurement update_pieces = Measure([&] {
+        map_renderer::MapRenderer renderer;
+        changed_pieces = renderer.RenderPieces(changed_layout, map_pieces.get());
+    });
+    PrintRow("RenderPieces (1 bus)", update_pieces, 0.0, "");
+    std::cout << "  pieces rendered after change: " << changed_pieces->GetRenderedCount() << " of "
+              << changed_pieces->GetRenderedCount() + changed_pieces->GetReusedCount() << '\n';
+
+    std::optional<map_renderer::MapIndex> map_index;
+    const Measurement build_map_index = Measure([&] {
+        profiler::ScopedSubsystem subsystem(profiler::Subsystem::MapIndex);
+        map_index.emplace(map_layout);
+    });
+    PrintRow("MapIndex build", build_map_index, 0.0, "");
+
+    // Выделение маршрута из трёх участков случайных автобусов для запроса RouteMap: базовые слои карты
+    // отрисовываются один раз, поэтому на запрос приходится только наложение
+    size_t overlay_size = 0;
+    const Measurement render_overlays = Measure([&] {
+        std::vector<map_renderer::RouteRide> rides;
+        std::vector<std::string_view> stops;
+        for (size_t i = 0; i < settings.queries; ++i) {
+            rides.clear();
+            stops.clear();
+            for (int ride = 0; ride < 3; ++ride) {
+                const auto& bus = *map_layout->GetBuses()[random() % map_layout->GetBuses().size()];
+                const size_t span = bus.stops.size() / 2;
+                rides.push_back({bus.name, bus.stops.front()->name, bus.stops[span]->name, span});
+                stops.push_back(bus.stops.front()->name);
+            }
+            svg::DocumentFragment fragment;
+            map_renderer::RenderRouteOverlay(fragment, *map_layout, rides, stops);
+            overlay_size += fragment.GetText().size();
+        }
+    });
+    PrintRow("RouteOverlay", render_overlays, static_cast<double>(settings.queries), "ops/s");
+    checksum += overlay_size;
+
+    // Случайные тайлы уровня, на котором тайлов примерно столько же, сколько маршрутов
+    uint32_t tile_zoom = 0;
+    while (tile_zoom < map_renderer::MAX_TILE_ZOOM && (size_t{1} << (2 * tile_zoom)) < bus_count) {
+        ++tile_zoom;
+    }
+    size_t tile_size = 0;
+    const Measurement render_tiles = Measure([&] {
+        for (size_t i = 0; i < settings.queries; ++i) {
+            const auto x = static_cast<uint32_t>(random() % (size_t{1} << tile_zoom));
+            const auto y = static_cast<uint32_t>(random() % (size_t{1} << tile_zoom));
+            map_index->RenderTile(tile_zoom, x, y, [&tile_size](std::string_view chunk) {
+                tile_size += chunk.size();
+            });
+        }
+    });
+    PrintRow("RenderTile z=" + std::to_string(tile_zoom), render_tiles, static_cast<double>(settings.queries), "ops/s");
+    checksum += tile_size;
+
+    // Случайные области со стороной в десятую часть города, выводимые в размер всей карты
+    double min_lat = std::numeric_limits<double>::max();
+    double max_lat = std::numeric_limits<double>::lowest();
+    double min_lng = std::numeric_limits<double>::max();
+    double max_lng = std::numeric_limits<double>::lowest();
+    for (const auto& [name, stop] : catalogue.GetStopNameToStopMap()) {
+        min_lat = std::min(min_lat, stop->coord.lat);
+        max_lat = std::max(max_lat, stop->coord.lat);
+        min_lng = std::min(min_lng, stop->coord.lng);
+        max_lng = std::max(max_lng, stop->coord.lng);
+    }
+    const double area_lat = (max_lat - min_lat) / 10;
+    const double area_lng = (max_lng - min_lng) / 10;
+    std::uniform_real_distribution<double> area_start(0.0, 0.9);
+    size_t area_size = 0;
+    const Measurement render_areas = Measure([&] {
+        for (size_t i = 0; i < settings.queries; ++i) {
+            const geo::Coordinates south_west{min_lat + (max_lat - min_lat) * area_start(random), min_lng + (max_lng - min_lng) * area_start(random)};
+            map_index->RenderArea(south_west, {south_west.lat + area_lat, south_west.lng + area_lng}, render_settings.width, render_settings.height,
+                                   [&area_size](std::string_view chunk) {
+                                       area_size += chunk.size();
+                                   });
+        }
+    });
+    PrintRow("RenderArea 1/10", render_areas, static_cast<double>(settings.queries), "ops/s");
+    checksum += area_size;
+
+    std::cout << "  peak RSS: " << std::fixed << std::setprecision(1) << PeakRssMb() << " MB, checksum: " << checksum << "\n\n";
+}
+
+std::vector<size_t> ParseSizes(std::string_view text) {
+    std::vector<size_t> sizes;
+    while (!text.empty()) {
+        const size_t comma = std::min(text.find(','), text.size());
+        sizes.push_back(std::stoul(std::string(text.substr(0, comma))));
+        text.remove_prefix(std::min(comma + 1, text.size()));
+    }
+    return sizes;
+}
+
+BenchmarkSettings ParseArgs(int argc, char* argv[]) {
+    BenchmarkSettings settings;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        if (arg == "--perf-counters") {
+            settings.perf_counters = true;
+            continue;
+        }
+        if (i + 1 == argc) {
+            throw std::invalid_argument("Missing value for " + std::string(arg));
+        }
+        const std::string value = argv[++i];
+        if (arg == "--sizes") {
+            settings.sizes = ParseSizes(value);
+        } else if (arg == "--bus-ratio") {
+            settings.generator.bus_ratio = std::stod(value);
+        } else if (arg == "--stops-per-bus") {
+            settings.generator.stops_per_bus = std::stoul(value);
+        } else if (arg == "--roundtrip-ratio") {
+            settings.generator.roundtrip_ratio = std::stod(value);
+        } else if (arg == "--distance-density") {
+            settings.generator.distance_density = std::stoul(value);
+        } else if (arg == "--queries") {
+            settings.queries = std::max<size_t>(1, std::stoul(value));
+        } else if (arg == "--router-max-stops") {
+            settings.router_max_stops = std::stoul(value);
+        } else if (arg == "--seed") {
+            settings.generator.seed = std::stoull(value);
+        } else {
+            throw std::invalid_argument("Unknown argument " + std::string(arg));
+        }
+    }
+    if (std::find(settings.sizes.begin(), settings.sizes.end(), 0) != settings.sizes.end()) {
+        throw std::invalid_argument("Sizes must be positive");
+    }
+    return settings;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    try {
+        const BenchmarkSettings settings = ParseArgs(argc, argv);
+        // Профилировщик считает выделения памяти и разбивает BuildGraph на фазы
+        profiler::Enable();
+        if (settings.perf_counters) {
+            profiler::EnableHardwareCounters();
+            if (const perf_counters::Counters probe; !probe.GetError().empty()) {
+                std::cerr << "Warning: some hardware counters are unavailable (" << probe.GetError() << ")\n";
+            }
+        }
+        for (size_t size : settings.sizes) {
+            RunSize(settings, size);
+        }
+        // Учёт памяти по подсистемам включается переменной окружения до запуска
+        if (profiler::IsMemoryAccountingActive()) {
+            std::cout << "memory by subsystem:\n";
+            profiler::PrintMemoryReport(std::cout);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include "format.h"
+
+#include <ostream>
+
+namespace format {
+
+using namespace std::literals;
+
+Writer::Writer(std::ostream& out, size_t flush_threshold)
+    : out_(&out)
+    , buffer_(own_buffer_)
+    , flush_threshold_(flush_threshold) {
+    own_buffer_.reserve(flush_threshold_ + flush_threshold_ / 4);
+}
+
+Writer::Writer(std::string& out)
+    : buffer_(out) {
+}
+
+Writer::~Writer() {
+    Flush();
+}
+
+void Writer::Flush() {
+    if (out_ != nullptr && !buffer_.empty()) {
+        out_->write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+        buffer_.clear();
+    }
+}
+
+void Writer::WriteDouble(double value, int precision) {
+    char chars[32];
+    const auto result = std::to_chars(chars, chars + sizeof(chars), value, std::chars_format::general, precision);
+    Write({chars, static_cast<size_t>(result.ptr - chars)});
+}
+
+void Writer::WriteJsonEscaped(std::string_view sv) {
+    size_t pos = 0;
+    while (pos < sv.size()) {
+        const size_t special = detail::FindFirstOf<'"', '\\', '\n', '\r', '\t'>(sv, pos);
+        buffer_.append(sv.data() + pos, special - pos);
+        if (special == sv.size()) {
+            break;
+        }
+        switch (sv[special]) {
+            case '\r':
+                buffer_.append("\\r"sv);
+                break;
+            case '\n':
+                buffer_.append("\\n"sv);
+                break;
+            case '\t':
+                buffer_.append("\\t"sv);
+                break;
+            default:
+                // Символы " и \ выводятся как \" или \\, соответственно
+                buffer_.push_back('\\');
+                buffer_.push_back(sv[special]);
+                break;
+        }
+        pos = special + 1;
+        MaybeFlush();
+    }
+    MaybeFlush();
+}
+
+void Writer::WriteHtmlEscaped(std::string_view sv) {
+    size_t pos = 0;
+    while (pos < sv.size()) {
+        const size_t special = detail::FindFirstOf<'"', '<', '>', '&', '\''>(sv, pos);
+        buffer_.append(sv.data() + pos, special - pos);
+        if (special == sv.size()) {
+            break;
+        }
+        switch (sv[special]) {
+            case '"':
+                buffer_.append("&quot;"sv);
+                break;
+            case '<':
+                buffer_.append("&lt;"sv);
+                break;
+            case '>':
+                buffer_.append("&gt;"sv);
+                break;
+            case '&':
+                buffer_.append("&amp;"sv);
+                break;
+            default:
+                buffer_.append("&apos;"sv);
+                break;
+        }
+        pos = special + 1;
+        MaybeFlush();
+    }
+    MaybeFlush();
+}
+
+}  // namespace format
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace format {
+
+// Точность вывода вещественных чисел, совпадающая с точностью std::ostream по умолчанию
+inline constexpr int DEFAULT_DOUBLE_PRECISION = 6;
+
+namespace detail {
+
+template <char... Chars>
+constexpr bool IsAnyOf(char c) {
+    return ((c == Chars) || ...);
+}
+
+/*
+ * Возвращает позицию первого символа из набора Chars в sv, начиная с pos,
+ * либо sv.size(), если таких символов нет.
+ * При наличии SSE2 строка просматривается блоками по 16 байт
+ */
+template <char... Chars>
+size_t FindFirstOf(std::string_view sv, size_t pos = 0) {
+    const char* data = sv.data();
+    const size_t size = sv.size();
+#if defined(__SSE2__)
+    for (; pos + 16 <= size; pos += 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        __m128i matches = _mm_setzero_si128();
+        ((matches = _mm_or_si128(matches, _mm_cmpeq_epi8(block, _mm_set1_epi8(Chars)))), ...);
+        if (const int mask = _mm_movemask_epi8(matches); mask != 0) {
+            return pos + static_cast<size_t>(__builtin_ctz(static_cast<unsigned>(mask)));
+        }
+    }
+#endif
+    for (; pos < size; ++pos) {
+        if (IsAnyOf<Chars...>(data[pos])) {
+            return pos;
+        }
+    }
+    return size;
+}
+
+}  // namespace detail
+
+/*
+ * Буферизованный вывод текста для JSON и SVG.
+ * Накапливает данные во внутреннем буфере и сбрасывает его в поток крупными блоками,
+ * числа форматирует через std::to_chars без участия std::ostream.
+ * Writer, созданный над строкой, дописывает данные прямо в неё
+ */
+class Writer {
+public:
+    static constexpr size_t DEFAULT_FLUSH_THRESHOLD = 64 * 1024;
+
+    explicit Writer(std::ostream& out, size_t flush_threshold = DEFAULT_FLUSH_THRESHOLD);
+    explicit Writer(std::string& out);
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    ~Writer();
+
+    void Put(char c) {
+        buffer_.push_back(c);
+        MaybeFlush();
+    }
+
+    void Write(std::string_view sv) {
+        buffer_.append(sv);
+        MaybeFlush();
+    }
+
+    template <typename Int>
+    void WriteInt(Int value) {
+        char chars[24];
+        const auto result = std::to_chars(chars, chars + sizeof(chars), value);
+        Write({chars, static_cast<size_t>(result.ptr - chars)});
+    }
+
+    void WriteDouble(double value, int precision = DEFAULT_DOUBLE_PRECISION);
+
+    // Выводит строку, экранируя символы по правилам JSON (без обрамляющих кавычек)
+    void WriteJsonEscaped(std::string_view sv);
+
+    // Выводит строку, заменяя спецсимволы XML на сущности (&quot; &lt; и т.д.)
+    void WriteHtmlEscaped(std::string_view sv);
+
+    // Сбрасывает накопленные данные в поток. Для Writer над строкой ничего не делает
+    void Flush();
+
+    Writer& operator<<(char c) {
+        Put(c);
+        return *this;
+    }
+    Writer& operator<<(std::string_view sv) {
+        Write(sv);
+        return *this;
+    }
+    Writer& operator<<(const char* s) {
+        Write(s);
+        return *this;
+    }
+    Writer& operator<<(const std::string& s) {
+        Write(s);
+        return *this;
+    }
+    Writer& operator<<(double value) {
+        WriteDouble(value);
+        return *this;
+    }
+    template <typename Int, std::enable_if_t<std::is_integral_v<Int> && !std::is_same_v<Int, char>
+                                                 && !std::is_same_v<Int, bool>, int> = 0>
+    Writer& operator<<(Int value) {
+        WriteInt(value);
+        return *this;
+    }
+
+private:
+    void MaybeFlush() {
+        if (out_ != nullptr && buffer_.size() >= flush_threshold_) {
+            Flush();
+        }
+    }
+
+    std::ostream* out_ = nullptr;
+    std::string own_buffer_;
+    std::string& buffer_;
+    size_t flush_threshold_ = DEFAULT_FLUSH_THRESHOLD;
+};
+
+}  // namespace format
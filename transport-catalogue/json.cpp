@@ -1,5 +1,7 @@
 #include "json.h"
+#include "format.h"
 
+#include <algorithm>
 #include <iterator>
 
 namespace json {
@@ -223,18 +225,29 @@ Node LoadNode(std::istream& input) {
 }
 
 struct PrintContext {
-    std::ostream& out;
+    format::Writer& out;
     int indent_step = 4;
     int indent = 0;
+    // В компактном режиме отступы и переводы строк не выводятся
+    bool compact = false;
 
     void PrintIndent() const {
+        if (compact) {
+            return;
+        }
         for (int i = 0; i < indent; ++i) {
-            out.put(' ');
+            out.Put(' ');
+        }
+    }
+
+    void PrintLineBreak() const {
+        if (!compact) {
+            out.Put('\n');
         }
     }
 
     PrintContext Indented() const {
-        return {out, indent_step, indent_step + indent};
+        return {out, indent_step, indent_step + indent, compact};
     }
 };
 
@@ -245,31 +258,10 @@ void PrintValue(const Value& value, const PrintContext& ctx) {
     ctx.out << value;
 }
 
-void PrintString(const std::string& value, std::ostream& out) {
-    out.put('"');
-    for (const char c : value) {
-        switch (c) {
-            case '\r':
-                out << "\\r"sv;
-                break;
-            case '\n':
-                out << "\\n"sv;
-                break;
-            case '\t':
-                out << "\\t"sv;
-                break;
-            case '"':
-                // Символы " и \ выводятся как \" или \\, соответственно
-                [[fallthrough]];
-            case '\\':
-                out.put('\\');
-                [[fallthrough]];
-            default:
-                out.put(c);
-                break;
-        }
-    }
-    out.put('"');
+void PrintString(const std::string& value, format::Writer& out) {
+    out.Put('"');
+    out.WriteJsonEscaped(value);
+    out.Put('"');
 }
 
 template <>
@@ -277,6 +269,17 @@ void PrintValue<std::string>(const std::string& value, const PrintContext& ctx)
     PrintString(value, ctx.out);
 }
 
+template <>
+void PrintValue<RawJson>(const RawJson& value, const PrintContext& ctx) {
+    if (value.storage) {
+        for (const RawJson* part = &value; part != nullptr; part = part->next.get()) {
+            ctx.out.Write(part->text);
+        }
+    } else {
+        ctx.out << "null"sv;
+    }
+}
+
 template <>
 void PrintValue<std::nullptr_t>(const std::nullptr_t&, const PrintContext& ctx) {
     ctx.out << "null"sv;
@@ -293,44 +296,54 @@ void PrintValue<bool>(const bool& value, const PrintContext& ctx) {
 
 template <>
 void PrintValue<Array>(const Array& nodes, const PrintContext& ctx) {
-    std::ostream& out = ctx.out;
-    out << "[\n"sv;
+    format::Writer& out = ctx.out;
+    out.Put('[');
+    ctx.PrintLineBreak();
     bool first = true;
     auto inner_ctx = ctx.Indented();
     for (const Node& node : nodes) {
         if (first) {
             first = false;
         } else {
-            out << ",\n"sv;
+            out.Put(',');
+            ctx.PrintLineBreak();
         }
         inner_ctx.PrintIndent();
         PrintNode(node, inner_ctx);
     }
-    out.put('\n');
+    ctx.PrintLineBreak();
     ctx.PrintIndent();
-    out.put(']');
+    out.Put(']');
+}
+
+// Выводит очередную пару ключ-значение словаря вместе с предшествующим разделителем
+void PrintDictEntry(const std::string& key, const Node& node, const PrintContext& ctx, bool& first) {
+    format::Writer& out = ctx.out;
+    if (first) {
+        first = false;
+    } else {
+        out.Put(',');
+        ctx.PrintLineBreak();
+    }
+    auto inner_ctx = ctx.Indented();
+    inner_ctx.PrintIndent();
+    PrintString(key, out);
+    out << (ctx.compact ? ":"sv : ": "sv);
+    PrintNode(node, inner_ctx);
 }
 
 template <>
 void PrintValue<Dict>(const Dict& nodes, const PrintContext& ctx) {
-    std::ostream& out = ctx.out;
-    out << "{\n"sv;
+    format::Writer& out = ctx.out;
+    out.Put('{');
+    ctx.PrintLineBreak();
     bool first = true;
-    auto inner_ctx = ctx.Indented();
     for (const auto& [key, node] : nodes) {
-        if (first) {
-            first = false;
-        } else {
-            out << ",\n"sv;
-        }
-        inner_ctx.PrintIndent();
-        PrintString(key, ctx.out);
-        out << ": "sv;
-        PrintNode(node, inner_ctx);
+        PrintDictEntry(key, node, ctx, first);
     }
-    out.put('\n');
+    ctx.PrintLineBreak();
     ctx.PrintIndent();
-    out.put('}');
+    out.Put('}');
 }
 
 void PrintNode(const Node& node, const PrintContext& ctx) {
@@ -343,12 +356,142 @@ void PrintNode(const Node& node, const PrintContext& ctx) {
 
 }  // namespace
 
+bool operator==(const RawJson& lhs, const RawJson& rhs) {
+    if ((lhs.storage == nullptr) != (rhs.storage == nullptr)) {
+        return false;
+    }
+    // Части сравниваются по мере продвижения по обеим цепочкам, без склейки в одну строку
+    const RawJson* lhs_part = &lhs;
+    const RawJson* rhs_part = &rhs;
+    std::string_view lhs_text = lhs.text;
+    std::string_view rhs_text = rhs.text;
+    while (true) {
+        while (lhs_text.empty() && lhs_part->next) {
+            lhs_part = lhs_part->next.get();
+            lhs_text = lhs_part->text;
+        }
+        while (rhs_text.empty() && rhs_part->next) {
+            rhs_part = rhs_part->next.get();
+            rhs_text = rhs_part->text;
+        }
+        if (lhs_text.empty() || rhs_text.empty()) {
+            return lhs_text.empty() && rhs_text.empty();
+        }
+        const size_t common = std::min(lhs_text.size(), rhs_text.size());
+        if (lhs_text.substr(0, common) != rhs_text.substr(0, common)) {
+            return false;
+        }
+        lhs_text.remove_prefix(common);
+        rhs_text.remove_prefix(common);
+    }
+}
+
 Document Load(std::istream& input) {
     return Document{LoadNode(input)};
 }
 
-void Print(const Document& doc, std::ostream& output) {
-    PrintNode(doc.GetRoot(), PrintContext{output});
+void Print(const Document& doc, std::ostream& output, PrintMode mode) {
+    format::Writer writer(output);
+    Print(doc, writer, mode);
+}
+
+void Print(const Document& doc, format::Writer& output, PrintMode mode) {
+    PrintContext ctx{output};
+    ctx.compact = mode == PrintMode::Compact;
+    PrintNode(doc.GetRoot(), ctx);
+}
+
+ArrayPrinter::ArrayPrinter(format::Writer& output, PrintMode mode)
+    : output_(output)
+    , mode_(mode) {
+    PrintContext ctx{output_};
+    ctx.compact = mode_ == PrintMode::Compact;
+    output_.Put('[');
+    ctx.PrintLineBreak();
+}
+
+void ArrayPrinter::PrintElementTo(const Node& node, format::Writer& output, PrintMode mode) {
+    PrintContext ctx{output};
+    ctx.compact = mode == PrintMode::Compact;
+    PrintNode(node, ctx.Indented());
+}
+
+void ArrayPrinter::PrintElement(const Node& node) {
+    PrintSeparator();
+    PrintElementTo(node, output_, mode_);
+}
+
+void ArrayPrinter::PrintElement(const DictTemplate& dict, const Node& value) {
+    PrintSeparator();
+    dict.PrintElementTo(value, output_);
+}
+
+void ArrayPrinter::PrintRawElement(std::string_view element) {
+    PrintSeparator();
+    output_.Write(element);
+}
+
+void ArrayPrinter::End() {
+    PrintContext ctx{output_};
+    ctx.compact = mode_ == PrintMode::Compact;
+    ctx.PrintLineBreak();
+    output_.Put(']');
+}
+
+void ArrayPrinter::PrintSeparator() {
+    PrintContext ctx{output_};
+    ctx.compact = mode_ == PrintMode::Compact;
+    if (first_) {
+        first_ = false;
+    } else {
+        output_.Put(',');
+        ctx.PrintLineBreak();
+    }
+    ctx.Indented().PrintIndent();
+}
+
+DictTemplate::DictTemplate(const Dict& dict, const std::string& key, PrintMode mode)
+    : compact_(mode == PrintMode::Compact) {
+    auto it = dict.begin();
+    bool first = true;
+    {
+        format::Writer out(prefix_);
+        PrintContext ctx = PrintContext{out, 4, 0, compact_}.Indented();
+        out.Put('{');
+        ctx.PrintLineBreak();
+        for (; it != dict.end() && it->first < key; ++it) {
+            PrintDictEntry(it->first, it->second, ctx, first);
+        }
+        // Префикс заканчивается непосредственно перед значением ключа
+        if (!first) {
+            out.Put(',');
+            ctx.PrintLineBreak();
+        }
+        ctx.Indented().PrintIndent();
+        PrintString(key, out);
+        out << (compact_ ? ":"sv : ": "sv);
+        first = false;
+    }
+    {
+        format::Writer out(suffix_);
+        PrintContext ctx = PrintContext{out, 4, 0, compact_}.Indented();
+        if (it != dict.end() && it->first == key) {
+            ++it;
+        }
+        for (; it != dict.end(); ++it) {
+            PrintDictEntry(it->first, it->second, ctx, first);
+        }
+        ctx.PrintLineBreak();
+        ctx.PrintIndent();
+        out.Put('}');
+    }
+}
+
+void DictTemplate::PrintElementTo(const Node& value, format::Writer& output) const {
+    output.Write(prefix_);
+    PrintContext ctx{output, 4, 0, compact_};
+    PrintNode(value, ctx.Indented().Indented());
+    output.Write(suffix_);
 }
 
-}  // namespace json
\ No newline at end of file
+}  // namespace json
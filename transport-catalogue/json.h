@@ -2,10 +2,16 @@
 
 #include <iostream>
 #include <map>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
+namespace format {
+class Writer;
+}  // namespace format
+
 namespace json {
 
 class Node;
@@ -17,8 +23,33 @@ public:
     using runtime_error::runtime_error;
 };
 
+// Заранее сериализованный фрагмент JSON, который выводится как есть.
+// Текст фрагмента разделяется между узлами без копирования: storage владеет памятью,
+// в которой лежит text, - строкой или отображённым в память файлом. Без storage фрагмент выводится как null.
+// Фрагмент может продолжаться цепочкой next: так общие части ответа склеиваются с частными без копирования
+struct RawJson {
+    RawJson() = default;
+
+    explicit RawJson(std::shared_ptr<const std::string> str)
+        : text(str ? std::string_view(*str) : std::string_view())
+        , storage(std::move(str)) {
+    }
+
+    RawJson(std::shared_ptr<const void> storage, std::string_view text)
+        : text(text)
+        , storage(std::move(storage)) {
+    }
+
+    std::string_view text;
+    std::shared_ptr<const void> storage;
+    std::shared_ptr<const RawJson> next;
+};
+
+// Фрагменты равны, если равны их полные тексты, как бы они ни были разбиты на части
+bool operator==(const RawJson& lhs, const RawJson& rhs);
+
 class Node final
-    : private std::variant<std::nullptr_t, Array, Dict, bool, int, double, std::string> {
+    : private std::variant<std::nullptr_t, Array, Dict, bool, int, double, std::string, RawJson> {
 public:
     using variant::variant;
 	using Value = variant;
@@ -90,6 +121,18 @@ public:
         return std::get<std::string>(*this);
     }
 
+    bool IsRawJson() const {
+        return std::holds_alternative<RawJson>(*this);
+    }
+    const RawJson& AsRawJson() const {
+        using namespace std::literals;
+        if (!IsRawJson()) {
+            throw std::logic_error("Not a raw json"s);
+        }
+
+        return std::get<RawJson>(*this);
+    }
+
     bool IsDict() const {
         return std::holds_alternative<Dict>(*this);
     }
@@ -149,6 +192,57 @@ inline bool operator!=(const Document& lhs, const Document& rhs) {
 
 Document Load(std::istream& input);
 
-void Print(const Document& doc, std::ostream& output);
+// Pretty - вывод с отступами и переводами строк, Compact - минимальный JSON без пробелов
+enum class PrintMode {
+    Pretty,
+    Compact,
+};
+
+void Print(const Document& doc, std::ostream& output, PrintMode mode = PrintMode::Pretty);
+void Print(const Document& doc, format::Writer& output, PrintMode mode = PrintMode::Pretty);
+
+/*
+ * Словарь - элемент массива верхнего уровня, сериализованный заранее без значения ключа key.
+ * Позволяет многократно выводить один и тот же словарь с разными значениями этого ключа,
+ * не сериализуя остальные значения заново. Существующее значение key в dict игнорируется
+ */
+class DictTemplate {
+public:
+    DictTemplate(const Dict& dict, const std::string& key, PrintMode mode = PrintMode::Pretty);
+
+    void PrintElementTo(const Node& value, format::Writer& output) const;
+
+private:
+    std::string prefix_;
+    std::string suffix_;
+    bool compact_ = false;
+};
+
+/*
+ * Потоковый вывод массива верхнего уровня: элементы выводятся по одному,
+ * без построения общего дерева. Результат совпадает с выводом Print для того же массива
+ */
+class ArrayPrinter {
+public:
+    ArrayPrinter(format::Writer& output, PrintMode mode = PrintMode::Pretty);
+
+    // Сериализует node так, как он выглядит в качестве элемента массива верхнего уровня.
+    // Результат можно передать в PrintRawElement
+    static void PrintElementTo(const Node& node, format::Writer& output, PrintMode mode);
+
+    void PrintElement(const Node& node);
+    void PrintElement(const DictTemplate& dict, const Node& value);
+    void PrintRawElement(std::string_view element);
+
+    // Выводит закрывающую скобку массива
+    void End();
+
+private:
+    void PrintSeparator();
+
+    format::Writer& output_;
+    PrintMode mode_;
+    bool first_ = true;
+};
 
 }  // namespace json
\ No newline at end of file
@@ -1,6 +1,20 @@
 #include "json_reader.h"
+#include "format.h"
+#include "profiler.h"
+#include "request_metrics.h"
+#include "trace.h"
 #include "transport_router.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+
 namespace json_reader {
 
 void ParseColor(const json::Node& color_node, svg::Color& color) {
@@ -24,6 +38,265 @@ void ParseColor(const json::Node& color_node, svg::Color& color) {
     }
 }
 
+TransportBase::TransportBase(int bus_wait_time, double bus_velocity)
+    : router(bus_wait_time, bus_velocity), map_cache(render_settings, catalogue) {
+}
+
+TransportBaseHolder::TransportBaseHolder(std::shared_ptr<const TransportBase> base)
+    : base_(std::move(base)) {
+}
+
+std::shared_ptr<const TransportBase> TransportBaseHolder::Get() const {
+    std::lock_guard lock(mutex_);
+    return base_;
+}
+
+void TransportBaseHolder::Replace(std::shared_ptr<const TransportBase> base) {
+    {
+        std::lock_guard lock(mutex_);
+        base_.swap(base);
+    }
+    // Here base holds the previous version; it is freed outside the lock unless queries still use it
+}
+
+MapJsonCache::MapJsonCache(const map_renderer::RenderSettings& settings, const transport_catalogue::TransportCatalogue& catalogue)
+    : settings_(settings), catalogue_(catalogue) {
+}
+
+namespace {
+
+// Сохраняет SVG, который render передаёт фрагментами в приёмник, экранированной строкой JSON.
+// SVG экранируется по мере отрисовки, без промежуточной строки с картой
+template <typename Render>
+json::RawJson MakeSvgJson(Render render) {
+   auto escaped = std::make_shared<std::string>();
+   {
+       format::Writer writer(*escaped);
+       writer.Put('"');
+       render([&writer](std::string_view chunk) {
+           writer.WriteJsonEscaped(chunk);
+       });
+       writer.Put('"');
+   }
+   return json::RawJson{std::move(escaped)};
+}
+
+}  // namespace
+
+const std::shared_ptr<const map_renderer::MapLayout>& MapJsonCache::GetLayout() const {
+    std::call_once(layout_flag_, [this] {
+        profiler::ScopedPhase layout_phase("map.layout");
+        profiler::ScopedSubsystem subsystem(profiler::Subsystem::MapIndex);
+        layout_ = std::make_shared<const map_renderer::MapLayout>(settings_, catalogue_);
+    });
+    return layout_;
+}
+
+const map_disk_cache::SplitMap& MapJsonCache::GetSplitMap() const {
+    std::call_once(render_flag_, [this] {
+        std::optional<map_disk_cache::MapKey> disk_key;
+        if (disk_cache_) {
+            profiler::ScopedPhase load_phase("map.disk_cache");
+            disk_key = map_disk_cache::MapKey{map_disk_cache::HashMapFormat(), map_disk_cache::HashCatalogue(catalogue_),
+                                              map_disk_cache::HashRenderSettings(settings_)};
+            if (auto cached = disk_cache_->Load(*disk_key)) {
+                split_map_ = std::move(*cached);
+                return;
+            }
+        }
+
+        {
+            profiler::ScopedPhase render_phase("map.render_svg");
+            auto below = std::make_shared<std::string>();
+            auto above = std::make_shared<std::string>();
+            {
+                format::Writer below_writer(*below);
+                format::Writer above_writer(*above);
+                format::Writer* writer = &below_writer;
+                below_writer.Put('"');
+                RenderMap([&writer](std::string_view chunk) {
+                    writer->WriteJsonEscaped(chunk);
+                }, [&writer, &above_writer](svg::ObjectContainer&) {
+                    // Всё, что выводится после места выделения маршрута, попадает в верхнюю часть
+                    writer = &above_writer;
+                });
+                above_writer.Put('"');
+            }
+            split_map_.below = json::RawJson(std::move(below));
+            split_map_.above = std::make_shared<const json::RawJson>(std::move(above));
+        }
+
+        if (disk_key) {
+            // Карта уже отрисована, поэтому ошибка записи кэша не мешает ответу
+            try {
+                disk_cache_->Store(*disk_key, split_map_);
+            } catch (const std::exception& e) {
+                std::cerr << "Warning: " << e.what() << std::endl;
+            }
+        }
+    });
+    return split_map_;
+}
+
+json::RawJson MapJsonCache::Get() const {
+    const map_disk_cache::SplitMap& split_map = GetSplitMap();
+    json::RawJson map_json = split_map.below;
+    map_json.next = split_map.above;
+    return map_json;
+}
+
+void MapJsonCache::SetPrevious(const MapJsonCache& previous) {
+    if (map_disk_cache::HashRenderSettings(previous.settings_) != map_disk_cache::HashRenderSettings(settings_)) {
+        previous_pieces_.reset();
+        return;
+    }
+    std::lock_guard lock(previous.pieces_mutex_);
+    previous_pieces_ = previous.pieces_;
+}
+
+std::shared_ptr<const map_renderer::MapPieces> MapJsonCache::GetPieces() const {
+    std::call_once(pieces_flag_, [this] {
+        profiler::ScopedPhase pieces_phase("map.render_pieces");
+        map_renderer::MapRenderer renderer(thread_count_);
+        auto pieces = renderer.RenderPieces(*GetLayout(), previous_pieces_.get());
+        previous_pieces_.reset();
+        std::lock_guard lock(pieces_mutex_);
+        pieces_ = std::move(pieces);
+    });
+    std::lock_guard lock(pieces_mutex_);
+    return pieces_;
+}
+
+void MapJsonCache::RenderMap(svg::StreamDocument::Sink sink, const map_renderer::MapRenderer::Overlay& overlay) const {
+    if (incremental_) {
+        GetPieces()->Render(std::move(sink), overlay);
+        return;
+    }
+    map_renderer::MapRenderer renderer(thread_count_);
+    renderer.RenderSvg(*GetLayout(), std::move(sink), overlay);
+}
+
+const map_renderer::MapIndex& MapJsonCache::GetIndex() const {
+    std::call_once(index_flag_, [this] {
+        profiler::ScopedPhase index_phase("map.index");
+        profiler::ScopedSubsystem subsystem(profiler::Subsystem::MapIndex);
+        settings_hash_ = map_disk_cache::HashRenderSettings(settings_);
+        index_ = std::make_unique<map_renderer::MapIndex>(GetLayout());
+    });
+    return *index_;
+}
+
+std::optional<json::RawJson> MapJsonCache::GetArea(geo::Coordinates south_west, geo::Coordinates north_east, double width, double height) const {
+    const map_renderer::MapIndex& index = GetIndex();
+    bool rendered = false;
+    json::RawJson area = MakeSvgJson([&](svg::StreamDocument::Sink sink) {
+        rendered = index.RenderArea(south_west, north_east, width, height, std::move(sink));
+    });
+    if (!rendered) {
+        return std::nullopt;
+    }
+    return area;
+}
+
+json::RawJson MapJsonCache::GetRouteMap(const transport_catalogue::RouteResult& route, std::string_view to) const {
+    const map_disk_cache::SplitMap& split_map = GetSplitMap();
+
+    // Участок на автобусе начинается на остановке предыдущего ожидания и заканчивается на остановке следующего
+    // или на конечной остановке маршрута. Выделяются остановки ожиданий, то есть посадок, и конечная
+    std::vector<map_renderer::RouteRide> rides;
+    std::vector<std::string_view> stops;
+    std::string_view current_stop = to;
+    for (size_t i = 0; i < route.items.size(); ++i) {
+        const auto& item = route.items[i];
+        if (item.type == transport_catalogue::RouteItem::ItemType::Wait) {
+            current_stop = item.name;
+            stops.push_back(item.name);
+            continue;
+        }
+        const bool last = i + 1 == route.items.size();
+        const std::string_view next_stop = last ? to : std::string_view(route.items[i + 1].name);
+        rides.push_back({item.name, current_stop, next_stop, item.span_count});
+        current_stop = next_stop;
+    }
+    stops.push_back(to);
+
+    auto overlay = std::make_shared<std::string>();
+    {
+        format::Writer writer(*overlay);
+        svg::DocumentFragment fragment;
+        map_renderer::RenderRouteOverlay(fragment, *GetLayout(), rides, stops);
+        writer.WriteJsonEscaped(fragment.GetText());
+    }
+    auto overlay_json = std::make_shared<json::RawJson>(std::move(overlay));
+    overlay_json->next = split_map.above;
+    json::RawJson route_map = split_map.below;
+    route_map.next = std::move(overlay_json);
+    return route_map;
+}
+
+size_t MapJsonCache::TileKeyHasher::operator()(const TileKey& key) const {
+    size_t hash = static_cast<size_t>(key.settings_hash);
+    for (const uint32_t value : {key.zoom, key.x, key.y}) {
+        hash = hash * 1000003 + value;
+    }
+    return hash;
+}
+
+std::optional<json::RawJson> MapJsonCache::GetTile(uint32_t zoom, uint32_t x, uint32_t y) const {
+    if (!map_renderer::IsValidTile(zoom, x, y)) {
+        return std::nullopt;
+    }
+    const map_renderer::MapIndex& index = GetIndex();
+    const TileKey key{settings_hash_, zoom, x, y};
+    {
+        std::lock_guard lock(tiles_mutex_);
+        if (const auto it = tile_positions_.find(key); it != tile_positions_.end()) {
+            tiles_.splice(tiles_.begin(), tiles_, it->second);
+            return it->second->second;
+        }
+    }
+
+    // Тайл отрисовывается без блокировки; если его одновременно отрисовали несколько потоков, в кэше остаётся первый
+    profiler::ScopedSubsystem subsystem(profiler::Subsystem::MapIndex);
+    json::RawJson tile = MakeSvgJson([&](svg::StreamDocument::Sink sink) {
+        index.RenderTile(zoom, x, y, std::move(sink));
+    });
+    const size_t tile_size = tile.text.size();
+    if (tile_size > TILE_CACHE_CAPACITY) {
+        return tile;
+    }
+
+    std::lock_guard lock(tiles_mutex_);
+    if (const auto it = tile_positions_.find(key); it != tile_positions_.end()) {
+        return it->second->second;
+    }
+    while (tiles_size_ + tile_size > TILE_CACHE_CAPACITY) {
+        tiles_size_ -= tiles_.back().second.text.size();
+        tile_positions_.erase(tiles_.back().first);
+        tiles_.pop_back();
+    }
+    tiles_.emplace_front(key, tile);
+    tile_positions_.emplace(key, tiles_.begin());
+    tiles_size_ += tile_size;
+    return tile;
+}
+
+void JsonReader::SetPrintMode(json::PrintMode mode) {
+    print_mode_ = mode;
+}
+
+void JsonReader::SetThreadCount(size_t thread_count) {
+    thread_count_ = thread_count;
+}
+
+void JsonReader::SetMapCacheDirectory(const std::string& directory) {
+    map_disk_cache_ = directory.empty() ? nullptr : std::make_shared<const map_disk_cache::MapDiskCache>(directory);
+}
+
+void JsonReader::SetIncrementalMap(bool incremental) {
+    incremental_map_ = incremental;
+}
+
 void JsonReader::ProcessRenderSettings(const json::Node& node, map_renderer::RenderSettings& settings) {
     settings.width = node.AsDict().at("width").AsDouble();
     settings.height = node.AsDict().at("height").AsDouble();
@@ -53,6 +326,10 @@ void JsonReader::ProcessRenderSettings(const json::Node& node, map_renderer::Ren
 
     settings.underlayer_width = node.AsDict().at("underlayer_width").AsDouble();
 
+    if (const auto it = node.AsDict().find("simplify_tolerance"); it != node.AsDict().end()) {
+        settings.simplify_tolerance = it->second.AsDouble();
+    }
+
     json::Node color_palette_node = node.AsDict().at("color_palette");
     
     for (const auto& color_node : color_palette_node.AsArray()) {
@@ -64,9 +341,14 @@ void JsonReader::ProcessRenderSettings(const json::Node& node, map_renderer::Ren
     }
 }
 
-void JsonReader::ProcessStateRequest(const json::Node& node, transport_catalogue::TransportCatalogue& catalogue, std::string map_json, json::Builder& response_array, const transport_catalogue::TransportRouter& router) {
+void JsonReader::ProcessStateRequest(const json::Node& node, const transport_catalogue::TransportCatalogue& catalogue, const MapJsonCache& map_cache, json::Builder& response_array, const transport_catalogue::TransportRouter& router) const {
    const auto& type = node.AsDict().at("type").AsString();
    const auto& id = node.AsDict().at("id").AsInt();
+   TRACE_SPAN("stat", "stat.request", type);
+
+   const bool collect_metrics = request_metrics::IsEnabled();
+   const auto start_time = collect_metrics ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+   bool not_found = false;
 
    response_array.StartDict().Key("request_id").Value(id);
 
@@ -80,12 +362,14 @@ void JsonReader::ProcessStateRequest(const json::Node& node, transport_catalogue
                          .Key("stop_count").Value(bus_info->stops_count)
                          .Key("unique_stop_count").Value(bus_info->unique_stops_count);
        } else {
+           not_found = true;
            response_array.Key("error_message").Value("not found");
        }
    } else if (type == "Stop") {
        const auto& stop_name = node.AsDict().at("name").AsString();
        const transport_catalogue::Stop* stop_ptr = catalogue.FindStop(stop_name);
        if (!stop_ptr) {
+           not_found = true;
            response_array.Key("error_message").Value("not found");
        } else {
            auto buses = catalogue.GetBusesByStop(stop_name);
@@ -98,16 +382,73 @@ void JsonReader::ProcessStateRequest(const json::Node& node, transport_catalogue
            response_array.Key("buses").Value(std::move(bus_array));
        }
    } else if (type == "Map") {
-       response_array.Key("map").Value(map_json);
+       const auto& request = node.AsDict();
+       if (const auto bbox_it = request.find("bbox"); bbox_it == request.end()) {
+           response_array.Key("map").Value(map_cache.Get());
+       } else {
+           // Область карты с размером изображения; по умолчанию размер берётся из render_settings
+           const auto& bbox = bbox_it->second.AsDict();
+           const auto size_or = [&request](const char* key, double default_size) {
+               const auto it = request.find(key);
+               return it == request.end() ? default_size : it->second.AsDouble();
+           };
+           auto area = map_cache.GetArea({bbox.at("min_lat").AsDouble(), bbox.at("min_lng").AsDouble()},
+                                         {bbox.at("max_lat").AsDouble(), bbox.at("max_lng").AsDouble()},
+                                         size_or("width", map_cache.GetSettings().width), size_or("height", map_cache.GetSettings().height));
+           if (area) {
+               response_array.Key("map").Value(std::move(*area));
+           } else {
+               not_found = true;
+               response_array.Key("error_message").Value("not found");
+           }
+       }
+   } else if (type == "MapTile") {
+       const auto& request = node.AsDict();
+       const int zoom = request.at("zoom").AsInt();
+       const int x = request.at("x").AsInt();
+       const int y = request.at("y").AsInt();
+       std::optional<json::RawJson> tile;
+       if (zoom >= 0 && x >= 0 && y >= 0) {
+           tile = map_cache.GetTile(static_cast<uint32_t>(zoom), static_cast<uint32_t>(x), static_cast<uint32_t>(y));
+       }
+       if (tile) {
+           response_array.Key("map").Value(std::move(*tile));
+       } else {
+           not_found = true;
+           response_array.Key("error_message").Value("not found");
+       }
+   } else if (type == "Stats") {
+       std::string stats;
+       {
+           format::Writer writer(stats);
+           request_metrics::PrintReport(writer);
+       }
+       response_array.Key("stats").Value(json::RawJson{std::make_shared<const std::string>(std::move(stats))});
+   } else if (type == "RouteMap") {
+       const auto& request = node.AsDict();
+       const auto& from_stop = request.at("from").AsString();
+       const auto& to_stop = request.at("to").AsString();
+       std::optional<transport_catalogue::RouteResult> route_info;
+       if (catalogue.FindStop(from_stop) && catalogue.FindStop(to_stop)) {
+           route_info = router.FindRoute(from_stop, to_stop);
+       }
+       if (route_info) {
+           response_array.Key("map").Value(map_cache.GetRouteMap(*route_info, to_stop));
+       } else {
+           not_found = true;
+           response_array.Key("error_message").Value("not found");
+       }
    } else if (type == "Route") {
         const auto& from_stop = node.AsDict().at("from").AsString();
         const auto& to_stop = node.AsDict().at("to").AsString();
 
         if (!catalogue.FindStop(from_stop) || !catalogue.FindStop(to_stop)) {
+            not_found = true;
             response_array.Key("error_message").Value("not found");
         } else {
             auto route_info = router.FindRoute(from_stop, to_stop);
             if (!route_info) {
+                not_found = true;
                 response_array.Key("error_message").Value("not found");
             } else {
                 response_array.Key("total_time").Value(route_info->total_time); 
@@ -130,6 +471,124 @@ void JsonReader::ProcessStateRequest(const json::Node& node, transport_catalogue
     }
 
    response_array.EndDict();
+
+   if (collect_metrics) {
+       const auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_time);
+       request_metrics::Record(type, static_cast<uint64_t>(latency.count()), not_found);
+   }
+}
+
+namespace {
+
+// Поле ключа записывается вместе с длиной: названия могут содержать любые символы,
+// и поля разных запросов не должны склеиваться в одинаковый ключ
+void AppendKeyField(std::string& key, std::string_view field) {
+   key += std::to_string(field.size());
+   key += ':';
+   key += field;
+}
+
+}  // namespace
+
+std::string MakeStatRequestKey(const json::Dict& request) {
+   const auto& type = request.at("type").AsString();
+   std::string key;
+   AppendKeyField(key, type);
+   if (type == "Bus" || type == "Stop") {
+       AppendKeyField(key, request.at("name").AsString());
+   } else if (type == "Map" && request.count("bbox") != 0) {
+       // Координаты записываются без округления, чтобы близкие области не совпали
+       std::string number;
+       const auto append_number = [&key, &number](double value) {
+           number.clear();
+           {
+               format::Writer writer(number);
+               writer.WriteDouble(value, std::numeric_limits<double>::max_digits10);
+           }
+           AppendKeyField(key, number);
+       };
+       const auto& bbox = request.at("bbox").AsDict();
+       for (const char* coordinate : {"min_lat", "min_lng", "max_lat", "max_lng"}) {
+           append_number(bbox.at(coordinate).AsDouble());
+       }
+       for (const char* size : {"width", "height"}) {
+           if (const auto it = request.find(size); it != request.end()) {
+               append_number(it->second.AsDouble());
+           } else {
+               AppendKeyField(key, {});
+           }
+       }
+   } else if (type == "Route" || type == "RouteMap") {
+       AppendKeyField(key, request.at("from").AsString());
+       AppendKeyField(key, request.at("to").AsString());
+   } else if (type == "MapTile") {
+       for (const char* coordinate : {"zoom", "x", "y"}) {
+           AppendKeyField(key, std::to_string(request.at(coordinate).AsInt()));
+       }
+   }
+   return key;
+}
+
+StatRequestsPlan PlanStateRequests(const json::Array& requests) {
+   StatRequestsPlan plan;
+   plan.distinct_index.reserve(requests.size());
+
+   std::unordered_map<std::string, size_t> key_to_index;
+   for (const auto& request : requests) {
+       const auto& req_map = request.AsDict();
+       req_map.at("id").AsInt();
+
+       const auto [it, inserted] = key_to_index.emplace(MakeStatRequestKey(req_map), plan.distinct.size());
+       if (inserted) {
+           plan.distinct.push_back(&request);
+       }
+       plan.distinct_index.push_back(it->second);
+   }
+   return plan;
+}
+
+std::vector<std::optional<json::DictTemplate>> JsonReader::ProcessStateRequests(const std::vector<const json::Node*>& requests, const transport_catalogue::TransportCatalogue& catalogue, const MapJsonCache& map_cache, const transport_catalogue::TransportRouter& router, json::PrintMode print_mode) {
+   const size_t chunk_count = (requests.size() + STAT_REQUESTS_CHUNK_SIZE - 1) / STAT_REQUESTS_CHUNK_SIZE;
+   std::vector<std::optional<json::DictTemplate>> answers(requests.size());
+   std::vector<std::exception_ptr> errors(chunk_count);
+
+   // Chunks are taken by workers one by one, every answer is serialized without its request_id
+   std::atomic<size_t> next_chunk = 0;
+   auto worker = [&] {
+       for (size_t chunk_index = next_chunk++; chunk_index < chunk_count; chunk_index = next_chunk++) {
+           TRACE_SPAN("stat", "stat.chunk");
+           try {
+               const size_t begin = chunk_index * STAT_REQUESTS_CHUNK_SIZE;
+               const size_t end = std::min(begin + STAT_REQUESTS_CHUNK_SIZE, requests.size());
+               for (size_t i = begin; i < end; ++i) {
+                   json::Builder builder;
+                   ProcessStateRequest(*requests[i], catalogue, map_cache, builder, router);
+                   answers[i].emplace(builder.Build().AsDict(), "request_id", print_mode);
+               }
+           } catch (...) {
+               errors[chunk_index] = std::current_exception();
+           }
+       }
+   };
+
+   size_t thread_count = thread_count_ != 0 ? thread_count_ : std::max(1u, std::thread::hardware_concurrency());
+   thread_count = std::min(thread_count, chunk_count);
+
+   std::vector<std::thread> threads;
+   for (size_t i = 1; i < thread_count; ++i) {
+       threads.emplace_back(worker);
+   }
+   worker();
+   for (auto& thread : threads) {
+       thread.join();
+   }
+
+   for (const auto& error : errors) {
+       if (error) {
+           std::rethrow_exception(error);
+       }
+   }
+   return answers;
 }
 
 void ParseBus(const json::Node& node, transport_catalogue::TransportCatalogue& catalogue) {
@@ -175,42 +634,135 @@ void ParseStop(const json::Node& node, transport_catalogue::TransportCatalogue&
    catalogue.AddStop(stop);
 }
 
-void JsonReader::ReadJson(std::istream& input, transport_catalogue::TransportCatalogue& catalogue, std::ostream& output) {
-   auto doc = json::Load(input);
-   const auto& root = doc.GetRoot().AsDict();
-
-   const auto& base_requests = root.at("base_requests").AsArray();
-
+void JsonReader::LoadBaseRequests(const json::Array& base_requests, transport_catalogue::TransportCatalogue& catalogue) {
    // First add all stops
-   for (const auto& request : base_requests) {
-       const auto& req_map = request.AsDict();
-       if (req_map.at("type").AsString() == "Stop") {
-           ParseStop(req_map, catalogue);
+   {
+       profiler::ScopedPhase phase("base.stops");
+       TRACE_SPAN("load", "base.stops");
+       for (const auto& request : base_requests) {
+           const auto& req_map = request.AsDict();
+           if (req_map.at("type").AsString() == "Stop") {
+               ParseStop(req_map, catalogue);
+           }
        }
    }
 
    // Add distances to neighboring stops
-   for (const auto& request : base_requests) {
-       const auto& req_map = request.AsDict();
-       if (req_map.at("type").AsString() == "Stop") {
-           const auto& stop_name = req_map.at("name").AsString();
-           const auto& road_distances = req_map.at("road_distances").AsDict();
-           const transport_catalogue::Stop* current_stop = catalogue.FindStop(stop_name);
-           if (current_stop) {
-               for (const auto& [key, value] : road_distances) {
-                   catalogue.AddStopsDistance(current_stop, catalogue.FindStop(key), value.AsInt());
+   {
+       profiler::ScopedPhase phase("base.distances");
+       TRACE_SPAN("load", "base.distances");
+       for (const auto& request : base_requests) {
+           const auto& req_map = request.AsDict();
+           if (req_map.at("type").AsString() == "Stop") {
+               const auto& stop_name = req_map.at("name").AsString();
+               const auto& road_distances = req_map.at("road_distances").AsDict();
+               const transport_catalogue::Stop* current_stop = catalogue.FindStop(stop_name);
+               if (current_stop) {
+                   for (const auto& [key, value] : road_distances) {
+                       catalogue.AddStopsDistance(current_stop, catalogue.FindStop(key), value.AsInt());
+                   }
                }
            }
        }
    }
 
    // Add routes
-   for (const auto& request : base_requests) {
-       const auto& req_map = request.AsDict();
-       if (req_map.at("type").AsString() == "Bus") {
-           ParseBus(req_map, catalogue);
+   {
+       profiler::ScopedPhase phase("base.buses");
+       TRACE_SPAN("load", "base.buses");
+       for (const auto& request : base_requests) {
+           const auto& req_map = request.AsDict();
+           if (req_map.at("type").AsString() == "Bus") {
+               ParseBus(req_map, catalogue);
+           }
        }
    }
+}
+
+std::unique_ptr<TransportBase> JsonReader::LoadBase(const json::Dict& root, const TransportBase* previous) {
+   const auto& routing_settings = root.at("routing_settings").AsDict();
+
+   auto base = std::make_unique<TransportBase>(routing_settings.at("bus_wait_time").AsInt(),
+                                               routing_settings.at("bus_velocity").AsDouble());
+
+   LoadBaseRequests(root.at("base_requests").AsArray(), base->catalogue);
+
+   base->router.BuildGraph(base->catalogue);
+
+   ProcessRenderSettings(root.at("render_settings"), base->render_settings);
+   base->map_cache.SetThreadCount(thread_count_);
+   base->map_cache.SetDiskCache(map_disk_cache_);
+   base->map_cache.SetIncremental(incremental_map_);
+   if (previous != nullptr) {
+       base->map_cache.SetPrevious(previous->map_cache);
+   }
+
+   return base;
+}
+
+void JsonReader::ProcessJsonLine(const TransportBase& base, std::string_view line, format::Writer& output,
+                                 std::chrono::steady_clock::time_point arrival) const {
+   json::Builder builder;
+   try {
+       std::istringstream line_stream{std::string(line)};
+       const auto request = json::Load(line_stream);
+       ProcessStateRequest(request.GetRoot(), base.catalogue, base.map_cache, builder, base.router);
+   } catch (const std::exception& e) {
+       builder = json::Builder{};
+       builder.StartDict().Key("error_message").Value(std::string(e.what())).EndDict();
+   }
+
+   const json::Document response{builder.Build()};
+   if (recorder_ == nullptr) {
+       json::Print(response, output, json::PrintMode::Compact);
+       output.Put('\n');
+       return;
+   }
+
+   std::string response_text;
+   {
+       format::Writer response_writer(response_text);
+       json::Print(response, response_writer, json::PrintMode::Compact);
+   }
+   recorder_->Record(arrival, line, response_text);
+   output << response_text;
+   output.Put('\n');
+}
+
+void JsonReader::SetRecorder(request_recorder::RequestRecorder* recorder) {
+   recorder_ = recorder;
+}
+
+bool JsonReader::IsBlankLine(std::string_view line) {
+   return line.find_first_not_of(" \t\r") == std::string_view::npos;
+}
+
+void JsonReader::ServeJsonLines(const TransportBaseHolder& base_holder, std::istream& input, std::ostream& output) const {
+   format::Writer writer(output);
+   std::string line;
+   while (std::getline(input, line)) {
+       const auto arrival = std::chrono::steady_clock::now();
+       if (IsBlankLine(line)) {
+           continue;
+       }
+
+       // Each answer takes exactly one line and is flushed right away
+       ProcessJsonLine(*base_holder.Get(), line, writer, arrival);
+       writer.Flush();
+       output.flush();
+   }
+}
+
+void JsonReader::ReadJson(std::istream& input, transport_catalogue::TransportCatalogue& catalogue, std::ostream& output) {
+   auto doc = [&input] {
+       profiler::ScopedPhase phase("json.load");
+       profiler::ScopedSubsystem subsystem(profiler::Subsystem::JsonDom);
+       TRACE_SPAN("load", "json.load");
+       return json::Load(input);
+   }();
+   const auto& root = doc.GetRoot().AsDict();
+
+   LoadBaseRequests(root.at("base_requests").AsArray(), catalogue);
 
    // Process routing settings
    const auto& routing_settings = root.at("routing_settings").AsDict();
@@ -230,24 +782,44 @@ void JsonReader::ReadJson(std::istream& input, transport_catalogue::TransportCat
    
    ProcessRenderSettings(render_settings_node, render_settings);
 
-   map_renderer::MapRenderer renderer;
+   // The map is rendered on the first Map request only
+   MapJsonCache map_cache(render_settings, catalogue);
+   map_cache.SetThreadCount(thread_count_);
+   map_cache.SetDiskCache(map_disk_cache_);
+
+   // Process output settings
+   json::PrintMode print_mode = print_mode_;
    
-   std::string map_json = renderer.RenderSvg(render_settings, catalogue);
+   if (const auto it = root.find("output_settings"); it != root.end()) {
+       const auto& output_settings = it->second.AsDict();
+       if (const auto compact_it = output_settings.find("compact");
+           compact_it != output_settings.end() && compact_it->second.AsBool()) {
+           print_mode = json::PrintMode::Compact;
+       }
+   }
 
    // Process state requests
-   json::Builder builder;
-   
-   auto response_array = builder.StartArray();
-   
    const auto& state_requests = root.at("stat_requests").AsArray(); 
-   
-   for (const auto& request : state_requests) {
-       ProcessStateRequest(request, catalogue, map_json, builder, router);
-   }
-   
-   response_array.EndArray();
 
-   json::Print(json::Document{builder.Build()}, output);
+   // Identical queries are answered once, the answer is printed for every request_id
+   std::optional<profiler::ScopedPhase> stat_phase(std::in_place, "stat.process");
+
+   const StatRequestsPlan plan = PlanStateRequests(state_requests);
+
+   const auto answers = ProcessStateRequests(plan.distinct, catalogue, map_cache, router, print_mode);
+
+   stat_phase.reset();
+
+   profiler::ScopedPhase print_phase("json.print");
+   TRACE_SPAN("output", "json.print");
+   format::Writer writer(output);
+   json::ArrayPrinter printer(writer, print_mode);
+   for (size_t i = 0; i < state_requests.size(); ++i) {
+       const int id = state_requests[i].AsDict().at("id").AsInt();
+       printer.PrintElement(*answers[plan.distinct_index[i]], json::Node(id));
+   }
+   printer.End();
+   writer.Flush();
 }    
 
 } // namespace json_reader
\ No newline at end of file
@@ -4,17 +4,217 @@
 #include "transport_catalogue.h"
 #include "svg.h"
 #include "map_renderer.h"
+#include "map_disk_cache.h"
 #include <sstream>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
 #include "json_builder.h"
+#include "request_recorder.h"
 #include "transport_router.h"
 
 namespace json_reader {
 
+// Отрисовывает карту при первом запросе Map и хранит её уже экранированной строкой JSON,
+// которую все ответы Map разделяют без копирования.
+// Тайлы запросов MapTile и области запросов Map с ключом bbox отрисовываются по пространственному индексу,
+// карты запросов RouteMap - наложением выделения маршрута на заранее отрисованные слои карты.
+// В режиме SetIncremental карта отрисовывается по частям, и следующая версия базы отрисовывает заново
+// только части изменившихся маршрутов и остановок.
+// Тайлы хранятся в кэше ограниченного объёма с вытеснением давно не запрошенных
+class MapJsonCache {
+public:
+    // Наибольший суммарный размер тайлов в кэше, байт
+    static constexpr size_t TILE_CACHE_CAPACITY = 64 * 1024 * 1024;
+
+    MapJsonCache(const map_renderer::RenderSettings& settings, const transport_catalogue::TransportCatalogue& catalogue);
+
+    json::RawJson Get() const;
+
+    // Число потоков отрисовки полной карты; 0 - по числу ядер
+    void SetThreadCount(size_t thread_count) {
+        thread_count_ = thread_count;
+    }
+
+    // Кэш полной карты на диске; без него карта отрисовывается при каждом запуске
+    void SetDiskCache(std::shared_ptr<const map_disk_cache::MapDiskCache> disk_cache) {
+        disk_cache_ = std::move(disk_cache);
+    }
+
+    // Отрисовывать карту по частям маршрутов и остановок, которые может использовать следующая версия базы
+    void SetIncremental(bool incremental) {
+        incremental_ = incremental;
+    }
+
+    // Предыдущая версия карты: её уже отрисованные части, данные которых не изменились, используются повторно.
+    // Вызывается после заполнения настроек; при других настройках отрисовки не действует
+    void SetPrevious(const MapJsonCache& previous);
+
+    const map_renderer::RenderSettings& GetSettings() const {
+        return settings_;
+    }
+
+    // Тайл карты; пустой результат - тайла с такими координатами нет
+    std::optional<json::RawJson> GetTile(uint32_t zoom, uint32_t x, uint32_t y) const;
+
+    // Карта географической области размером width x height; не кэшируется. Пустой результат - область пуста
+    std::optional<json::RawJson> GetArea(geo::Coordinates south_west, geo::Coordinates north_east, double width, double height) const;
+
+    // Карта с выделенным маршрутом route, который заканчивается на остановке to. Каждый запрос отрисовывает только
+    // выделение и без копирования вставляется между частями карты, общими с Get
+    json::RawJson GetRouteMap(const transport_catalogue::RouteResult& route, std::string_view to) const;
+
+private:
+    // Раскладка карты строится один раз и разделяется полной картой, тайлами и областями
+    const std::shared_ptr<const map_renderer::MapLayout>& GetLayout() const;
+    // Пространственный индекс строится при первом запросе тайла или области
+    const map_renderer::MapIndex& GetIndex() const;
+
+    // Передаёт SVG карты в sink; в режиме SetIncremental - из частей карты
+    void RenderMap(svg::StreamDocument::Sink sink, const map_renderer::MapRenderer::Overlay& overlay) const;
+    // Части карты отрисовываются один раз, с повторным использованием частей предыдущей версии
+    std::shared_ptr<const map_renderer::MapPieces> GetPieces() const;
+
+    // Карта, разделённая на части под выделением маршрута и над ним, загружается из кэша на диске
+    // или отрисовывается один раз и разделяется запросами Map и RouteMap
+    const map_disk_cache::SplitMap& GetSplitMap() const;
+
+    struct TileKey {
+        uint64_t settings_hash;
+        uint32_t zoom;
+        uint32_t x;
+        uint32_t y;
+
+        bool operator==(const TileKey& other) const {
+            return settings_hash == other.settings_hash && zoom == other.zoom && x == other.x && y == other.y;
+        }
+    };
+
+    struct TileKeyHasher {
+        size_t operator()(const TileKey& key) const;
+    };
+
+    using TileList = std::list<std::pair<TileKey, json::RawJson>>;
+
+    const map_renderer::RenderSettings& settings_;
+    const transport_catalogue::TransportCatalogue& catalogue_;
+    size_t thread_count_ = 0;
+    std::shared_ptr<const map_disk_cache::MapDiskCache> disk_cache_;
+    bool incremental_ = false;
+    // Части предыдущей версии нужны только до отрисовки своих
+    mutable std::shared_ptr<const map_renderer::MapPieces> previous_pieces_;
+    mutable std::once_flag pieces_flag_;
+    // Части читает и следующая версия базы, поэтому они защищены мьютексом
+    mutable std::mutex pieces_mutex_;
+    mutable std::shared_ptr<const map_renderer::MapPieces> pieces_;
+    mutable std::once_flag layout_flag_;
+    mutable std::shared_ptr<const map_renderer::MapLayout> layout_;
+    mutable std::once_flag render_flag_;
+    mutable map_disk_cache::SplitMap split_map_;
+
+    mutable std::once_flag index_flag_;
+    mutable std::unique_ptr<map_renderer::MapIndex> index_;
+    mutable uint64_t settings_hash_ = 0;
+    mutable std::mutex tiles_mutex_;
+    // Тайлы от недавно запрошенных к давно не запрошенным
+    mutable TileList tiles_;
+    mutable std::unordered_map<TileKey, TileList::iterator, TileKeyHasher> tile_positions_;
+    mutable size_t tiles_size_ = 0;
+};
+
+// Загруженная база: справочник, построенный маршрутизатор и отложенно отрисованная карта.
+// После загрузки используется только для чтения и может разделяться между потоками
+struct TransportBase {
+    TransportBase(int bus_wait_time, double bus_velocity);
+
+    TransportBase(const TransportBase&) = delete;
+    TransportBase& operator=(const TransportBase&) = delete;
+
+    transport_catalogue::TransportCatalogue catalogue;
+    transport_catalogue::TransportRouter router;
+    map_renderer::RenderSettings render_settings;
+    MapJsonCache map_cache;
+};
+
+// Текущая версия базы с возможностью атомарной замены.
+// Запрос берёт ссылку на версию через Get и дообрабатывается на ней, даже если версию успели заменить;
+// старая версия освобождается вместе с последней ссылкой на неё
+class TransportBaseHolder {
+public:
+    explicit TransportBaseHolder(std::shared_ptr<const TransportBase> base);
+
+    std::shared_ptr<const TransportBase> Get() const;
+    void Replace(std::shared_ptr<const TransportBase> base);
+
+private:
+    mutable std::mutex mutex_;
+    std::shared_ptr<const TransportBase> base_;
+};
+
+// План обработки stat_requests: одинаковые запросы с разными id вычисляются один раз.
+// distinct - первые вхождения различных запросов, distinct_index - номер различного запроса для каждого из запросов
+struct StatRequestsPlan {
+    std::vector<const json::Node*> distinct;
+    std::vector<size_t> distinct_index;
+};
+
+StatRequestsPlan PlanStateRequests(const json::Array& requests);
+
 class JsonReader {
 public:
+    // Режим вывода ответа; компактный режим также включается ключом output_settings входного документа
+    void SetPrintMode(json::PrintMode mode);
+
+    // Число потоков обработки stat_requests; 0 - по числу ядер
+    void SetThreadCount(size_t thread_count);
+
+    // Каталог кэша отрисованной карты; пустой путь выключает кэш
+    void SetMapCacheDirectory(const std::string& directory);
+
+    // Отрисовывать карты баз LoadBase по частям, чтобы перезагруженная база отрисовывала заново
+    // только изменившиеся маршруты и остановки
+    void SetIncrementalMap(bool incremental);
+
     void ProcessRenderSettings(const json::Node& node, map_renderer::RenderSettings& settings);
-    void ProcessStateRequest(const json::Node& node, transport_catalogue::TransportCatalogue& catalogue, std::string map_json, json::Builder& response_array, const transport_catalogue::TransportRouter& router);
+    void ProcessStateRequest(const json::Node& node, const transport_catalogue::TransportCatalogue& catalogue, const MapJsonCache& map_cache, json::Builder& response_array, const transport_catalogue::TransportRouter& router) const;
     void ReadJson(std::istream& input, transport_catalogue::TransportCatalogue& catalogue, std::ostream& output);
+
+    // Заполняет справочник остановками, расстояниями и маршрутами из base_requests
+    void LoadBaseRequests(const json::Array& base_requests, transport_catalogue::TransportCatalogue& catalogue);
+
+    // Загружает base_requests, routing_settings и render_settings документа; stat_requests не обрабатываются.
+    // previous - заменяемая версия базы, уже отрисованные части её карты используются повторно
+    std::unique_ptr<TransportBase> LoadBase(const json::Dict& root, const TransportBase* previous = nullptr);
+
+    // Режим JSON Lines: читает по одному запросу в строке и выводит по одному ответу в строке
+    void ServeJsonLines(const TransportBaseHolder& base_holder, std::istream& input, std::ostream& output) const;
+
+    // Обрабатывает один запрос в формате JSON Lines и выводит ответ одной строкой.
+    // Ошибка разбора запроса выводится ответом с ключом error_message.
+    // arrival - момент чтения запроса, который попадает в запись SetRecorder
+    void ProcessJsonLine(const TransportBase& base, std::string_view line, format::Writer& output,
+                         std::chrono::steady_clock::time_point arrival) const;
+
+    // Записывать запросы режима JSON Lines вместе с ответами; nullptr выключает запись
+    void SetRecorder(request_recorder::RequestRecorder* recorder);
+
+    static bool IsBlankLine(std::string_view line);
+
+private:
+    static constexpr size_t STAT_REQUESTS_CHUNK_SIZE = 256;
+
+    std::vector<std::optional<json::DictTemplate>> ProcessStateRequests(const std::vector<const json::Node*>& requests, const transport_catalogue::TransportCatalogue& catalogue, const MapJsonCache& map_cache, const transport_catalogue::TransportRouter& router, json::PrintMode print_mode);
+
+    json::PrintMode print_mode_ = json::PrintMode::Pretty;
+    size_t thread_count_ = 0;
+    std::shared_ptr<const map_disk_cache::MapDiskCache> map_disk_cache_;
+    bool incremental_map_ = false;
+    request_recorder::RequestRecorder* recorder_ = nullptr;
 };
 
 } // namespace json_reader
\ No newline at end of file
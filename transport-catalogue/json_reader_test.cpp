@@ -0,0 +1,314 @@
+// Регрессионные проверки обработки stat_requests и отрисовки карты.
+// Программа завершается с ненулевым кодом и описанием первой непрошедшей проверки.
+
+#include "format.h"
+#include "json.h"
+#include "json_reader.h"
+#include "map_disk_cache.h"
+#include "transport_catalogue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+using namespace std::literals;
+
+void Check(bool condition, const std::string& message) {
+    if (!condition) {
+        throw std::runtime_error(message);
+    }
+}
+
+// Город для проверок карты; названия не требуют экранирования в JSON
+struct TestStop {
+    std::string name;
+    double latitude;
+    double longitude;
+};
+
+struct TestBus {
+    std::string name;
+    std::vector<std::string> stops;
+    bool is_roundtrip;
+};
+
+struct TestCity {
+    std::vector<TestStop> stops;
+    std::vector<TestBus> buses;
+    std::string render_settings = R"({"width": 600, "height": 400, "padding": 50, "line_width": 14, "stop_radius": 5,
+        "bus_label_font_size": 20, "bus_label_offset": [7, 15], "stop_label_font_size": 20, "stop_label_offset": [7, -3],
+        "underlayer_color": [255, 255, 255, 0.85], "underlayer_width": 3, "color_palette": ["green", [255, 160, 0], "red"]})";
+};
+
+TestCity MakeTestCity() {
+    TestCity city;
+    city.stops = {{"a", 55.60, 37.60}, {"b", 55.61, 37.62}, {"c", 55.62, 37.61},
+                  {"d", 55.63, 37.64}, {"e", 55.64, 37.60}, {"f", 55.615, 37.63}};
+    city.buses = {{"1", {"a", "b", "c", "e"}, false},
+                  {"2", {"c", "d", "f", "c"}, true},
+                  {"3", {"b", "f", "d"}, false}};
+    return city;
+}
+
+// Документ базы; расстояние между соседними остановками маршрутов - 1000 м в обе стороны
+std::string MakeBaseJson(const TestCity& city) {
+    std::map<std::string, std::vector<std::string>> neighbours;
+    for (const auto& bus : city.buses) {
+        for (size_t i = 0; i + 1 < bus.stops.size(); ++i) {
+            neighbours[bus.stops[i]].push_back(bus.stops[i + 1]);
+            neighbours[bus.stops[i + 1]].push_back(bus.stops[i]);
+        }
+    }
+
+    std::ostringstream out;
+    out.precision(17);
+    out << R"({"base_requests": [)";
+    bool first = true;
+    for (const auto& stop : city.stops) {
+        out << (first ? "" : ", ") << R"({"type": "Stop", "name": ")" << stop.name << R"(", "latitude": )" << stop.latitude
+            << R"(, "longitude": )" << stop.longitude << R"(, "road_distances": {)";
+        auto& names = neighbours[stop.name];
+        std::sort(names.begin(), names.end());
+        names.erase(std::unique(names.begin(), names.end()), names.end());
+        for (size_t i = 0; i < names.size(); ++i) {
+            out << (i == 0 ? "" : ", ") << '"' << names[i] << R"(": 1000)";
+        }
+        out << "}}";
+        first = false;
+    }
+    for (const auto& bus : city.buses) {
+        out << R"(, {"type": "Bus", "name": ")" << bus.name << R"(", "stops": [)";
+        for (size_t i = 0; i < bus.stops.size(); ++i) {
+            out << (i == 0 ? "" : ", ") << '"' << bus.stops[i] << '"';
+        }
+        out << R"(], "is_roundtrip": )" << (bus.is_roundtrip ? "true" : "false") << "}";
+    }
+    out << R"(], "render_settings": )" << city.render_settings << R"(, "routing_settings": {"bus_wait_time": 2, "bus_velocity": 60}})";
+    return out.str();
+}
+
+std::unique_ptr<json_reader::TransportBase> LoadBase(json_reader::JsonReader& reader, const TestCity& city,
+                                                     const json_reader::TransportBase* previous = nullptr) {
+    std::istringstream input(MakeBaseJson(city));
+    const json::Document doc = json::Load(input);
+    return reader.LoadBase(doc.GetRoot().AsDict(), previous);
+}
+
+// Ответ на запрос в режиме JSON Lines без перевода строки
+std::string Answer(const json_reader::JsonReader& reader, const json_reader::TransportBase& base, std::string_view request) {
+    std::string answer;
+    {
+        format::Writer writer(answer);
+        reader.ProcessJsonLine(base, request, writer, std::chrono::steady_clock::now());
+    }
+    answer.pop_back();
+    return answer;
+}
+
+json::Document Process(const std::string& input) {
+    json_reader::JsonReader reader;
+    transport_catalogue::TransportCatalogue catalogue;
+    std::istringstream input_stream(input);
+    std::ostringstream output;
+    reader.ReadJson(input_stream, catalogue, output);
+    std::istringstream output_stream(output.str());
+    return json::Load(output_stream);
+}
+
+// Названия с переводом строки: маршруты "a\nb" -> "c" и "a" -> "b\nc" - разные запросы,
+// хотя поля, склеенные через перевод строки, у них совпадают
+void TestNewlineNamesAreDistinctRequests() {
+    const std::string input = R"({
+  "base_requests": [
+    {"type": "Stop", "name": "a", "latitude": 55.60, "longitude": 37.60, "road_distances": {"b\nc": 2000}},
+    {"type": "Stop", "name": "b\nc", "latitude": 55.61, "longitude": 37.61, "road_distances": {}},
+    {"type": "Stop", "name": "a\nb", "latitude": 55.62, "longitude": 37.62, "road_distances": {"c": 10000}},
+    {"type": "Stop", "name": "c", "latitude": 55.63, "longitude": 37.63, "road_distances": {}},
+    {"type": "Bus", "name": "1", "stops": ["a", "b\nc"], "is_roundtrip": false},
+    {"type": "Bus", "name": "2", "stops": ["a\nb", "c"], "is_roundtrip": false}
+  ],
+  "render_settings": {"width": 600, "height": 400, "padding": 50, "line_width": 14, "stop_radius": 5,
+                      "bus_label_font_size": 20, "bus_label_offset": [7, 15], "stop_label_font_size": 20,
+                      "stop_label_offset": [7, -3], "underlayer_color": "white", "underlayer_width": 3,
+                      "color_palette": ["green"]},
+  "routing_settings": {"bus_wait_time": 2, "bus_velocity": 60},
+  "stat_requests": [
+    {"id": 1, "type": "Route", "from": "a\nb", "to": "c"},
+    {"id": 2, "type": "Route", "from": "a", "to": "b\nc"},
+    {"id": 3, "type": "Stop", "name": "a\nb"},
+    {"id": 4, "type": "Stop", "name": "a"}
+  ]
+})";
+
+    json::Array requests;
+    {
+        std::istringstream stream(input);
+        requests = json::Load(stream).GetRoot().AsDict().at("stat_requests").AsArray();
+    }
+    Check(json_reader::PlanStateRequests(requests).distinct.size() == requests.size(),
+          "requests with newline-containing names share a plan entry");
+
+    const json::Document answers = Process(input);
+    const auto& array = answers.GetRoot().AsArray();
+    Check(array.size() == 4, "expected 4 answers");
+    Check(std::abs(array[0].AsDict().at("total_time").AsDouble() - 12.0) < 1e-6, "wrong total_time for a\\nb -> c");
+    Check(std::abs(array[1].AsDict().at("total_time").AsDouble() - 4.0) < 1e-6, "wrong total_time for a -> b\\nc");
+    Check(array[2].AsDict().at("buses").AsArray().at(0).AsString() == "2", "wrong buses for stop a\\nb");
+    Check(array[3].AsDict().at("buses").AsArray().at(0).AsString() == "1", "wrong buses for stop a");
+}
+
+// Карта базы, загруженной с SetPrevious и повторным использованием частей, совпадает с картой той же базы,
+// отрисованной целиком; то же для карты с выделенным маршрутом
+void CheckIncrementalMap(const TestCity& before, const TestCity& after, const std::string& change) {
+    json_reader::JsonReader incremental;
+    incremental.SetIncrementalMap(true);
+    const auto previous = LoadBase(incremental, before);
+    previous->map_cache.Get();
+    const auto base = LoadBase(incremental, after, previous.get());
+
+    json_reader::JsonReader batch;
+    const auto expected = LoadBase(batch, after);
+    Check(base->map_cache.Get() == expected->map_cache.Get(), "incremental Map differs from a full render after " + change);
+
+    const std::string route_map = R"({"id": 1, "type": "RouteMap", "from": "a", "to": "e"})";
+    const std::string route_map_answer = Answer(incremental, *base, route_map);
+    Check(route_map_answer.find(R"("map":)") != std::string::npos, "no RouteMap answer after " + change);
+    Check(route_map_answer == Answer(batch, *expected, route_map), "incremental RouteMap differs from a full render after " + change);
+}
+
+void TestIncrementalMapMatchesFullRender() {
+    const TestCity city = MakeTestCity();
+    CheckIncrementalMap(city, city, "no change");
+
+    TestCity reversed = city;
+    std::reverse(reversed.buses[1].stops.begin(), reversed.buses[1].stops.end());
+    CheckIncrementalMap(city, reversed, "reversing a bus");
+
+    // Новый маршрут между "1" и "2" сдвигает цвета следующих маршрутов
+    TestCity added = city;
+    added.buses.push_back({"15", {"d", "e"}, false});
+    CheckIncrementalMap(city, added, "adding a bus");
+
+    TestCity inserted = city;
+    inserted.buses[0].stops.insert(inserted.buses[0].stops.begin() + 2, "f");
+    CheckIncrementalMap(city, inserted, "inserting a stop into a bus");
+
+    TestCity removed = city;
+    removed.buses.erase(removed.buses.begin() + 1);
+    CheckIncrementalMap(city, removed, "removing a bus");
+    CheckIncrementalMap(removed, city, "restoring a removed bus");
+
+    // Остановка внутри рамки карты не меняет проекцию, за её пределами - меняет
+    TestCity moved_inside = city;
+    moved_inside.stops[5].latitude = 55.616;
+    moved_inside.stops[5].longitude = 37.625;
+    CheckIncrementalMap(city, moved_inside, "moving a stop inside the map frame");
+
+    TestCity moved_outside = city;
+    moved_outside.stops[0].latitude = 55.59;
+    moved_outside.stops[0].longitude = 37.59;
+    CheckIncrementalMap(city, moved_outside, "moving a stop outside the map frame");
+
+    TestCity restyled = city;
+    restyled.render_settings = R"({"width": 600, "height": 400, "padding": 50, "line_width": 10, "stop_radius": 5,
+        "bus_label_font_size": 20, "bus_label_offset": [7, 15], "stop_label_font_size": 20, "stop_label_offset": [7, -3],
+        "underlayer_color": "white", "underlayer_width": 3, "color_palette": ["blue", "green"], "simplify_tolerance": 3})";
+    CheckIncrementalMap(city, restyled, "changing render settings");
+}
+
+// Тайл уровня 0 совпадает с картой целиком, несуществующие тайлы - not found
+void CheckTiles(const TestCity& city, const std::string& variant) {
+    json_reader::JsonReader reader;
+    const auto base = LoadBase(reader, city);
+
+    const std::string map = Answer(reader, *base, R"({"id": 1, "type": "Map"})");
+    Check(map.find(R"("map":)") != std::string::npos, "no Map answer " + variant);
+    Check(Answer(reader, *base, R"({"id": 1, "type": "MapTile", "zoom": 0, "x": 0, "y": 0})") == map,
+          "zoom 0 tile differs from Map " + variant);
+    for (const char* tile : {R"({"id": 2, "type": "MapTile", "zoom": 1, "x": 0, "y": 0})",
+                             R"({"id": 2, "type": "MapTile", "zoom": 20, "x": 1048575, "y": 1048575})"}) {
+        Check(Answer(reader, *base, tile).find(R"("map":)") != std::string::npos, std::string("no answer to ") + tile + " " + variant);
+    }
+
+    const std::string not_found = R"({"error_message":"not found","request_id":3})";
+    for (const char* tile : {R"({"id": 3, "type": "MapTile", "zoom": 0, "x": 1, "y": 0})",
+                             R"({"id": 3, "type": "MapTile", "zoom": 0, "x": 0, "y": 1})",
+                             R"({"id": 3, "type": "MapTile", "zoom": 1, "x": 2, "y": 0})",
+                             R"({"id": 3, "type": "MapTile", "zoom": 21, "x": 0, "y": 0})",
+                             R"({"id": 3, "type": "MapTile", "zoom": -1, "x": 0, "y": 0})",
+                             R"({"id": 3, "type": "MapTile", "zoom": 1, "x": -1, "y": 0})",
+                             R"({"id": 3, "type": "MapTile", "zoom": 1, "x": 0, "y": -1})"}) {
+        Check(Answer(reader, *base, tile) == not_found, std::string("expected not found for ") + tile + " " + variant);
+    }
+}
+
+void TestTiles() {
+    const TestCity city = MakeTestCity();
+    CheckTiles(city, "without simplification");
+
+    // С допуском 40 пикселей у линий маршрутов остаётся часть вершин
+    TestCity simplified = city;
+    simplified.render_settings.insert(simplified.render_settings.size() - 1, R"(, "simplify_tolerance": 40)");
+    CheckTiles(simplified, "with simplification");
+
+    json_reader::JsonReader reader;
+    Check(Answer(reader, *LoadBase(reader, simplified), R"({"id": 1, "type": "Map"})")
+              != Answer(reader, *LoadBase(reader, city), R"({"id": 1, "type": "Map"})"),
+          "simplify_tolerance does not change the map");
+}
+
+// Карта, загруженная из кэша на диске при повторном запуске, совпадает с только что отрисованной;
+// карта с выделенным маршрутом при загрузке из кэша тоже не меняется
+void TestMapDiskCacheWarmStart() {
+    char directory[] = "/tmp/json_reader_test_XXXXXX";
+    Check(mkdtemp(directory) != nullptr, "cannot create a temporary directory");
+    const TestCity city = MakeTestCity();
+    const std::string route_map = R"({"id": 1, "type": "RouteMap", "from": "a", "to": "e"})";
+
+    json_reader::JsonReader fresh_reader;
+    const auto fresh = LoadBase(fresh_reader, city);
+
+    json_reader::JsonReader cold_reader;
+    cold_reader.SetMapCacheDirectory(directory);
+    Check(LoadBase(cold_reader, city)->map_cache.Get() == fresh->map_cache.Get(), "cold disk cache run differs from a fresh render");
+
+    const map_disk_cache::MapKey key{map_disk_cache::HashMapFormat(), map_disk_cache::HashCatalogue(fresh->catalogue),
+                                     map_disk_cache::HashRenderSettings(fresh->render_settings)};
+    Check(map_disk_cache::MapDiskCache(directory).Load(key).has_value(), "map was not stored in the disk cache");
+
+    json_reader::JsonReader warm_reader;
+    warm_reader.SetMapCacheDirectory(directory);
+    const auto warm = LoadBase(warm_reader, city);
+    Check(warm->map_cache.Get() == fresh->map_cache.Get(), "map loaded from the disk cache differs from a fresh render");
+    Check(Answer(warm_reader, *warm, route_map) == Answer(fresh_reader, *fresh, route_map),
+          "RouteMap over the map loaded from the disk cache differs from a fresh render");
+
+    std::filesystem::remove_all(directory);
+}
+
+}  // namespace
+
+int main() {
+    try {
+        TestNewlineNamesAreDistinctRequests();
+        TestIncrementalMapMatchesFullRender();
+        TestTiles();
+        TestMapDiskCacheWarmStart();
+    } catch (const std::exception& e) {
+        std::cerr << "FAILED: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "OK" << std::endl;
+    return 0;
+}
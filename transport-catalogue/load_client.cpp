@@ -0,0 +1,144 @@
+// Нагрузочный клиент для сервера запросов (query_server).
+// Открывает несколько соединений, в каждом по очереди отправляет запросы из файла JSON Lines
+// и ждёт ответа, после чего выводит пропускную способность и задержки.
+//
+// Использование:
+//   load_client (--socket PATH | --port N) --requests FILE [--connections C] [--count N]
+
+#include "socket_client.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct ClientSettings {
+    std::string unix_socket_path;
+    uint16_t tcp_port = 0;
+    std::string requests_path;
+    size_t connections = 4;
+    size_t count = 0;
+};
+
+double Percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    const size_t index = std::min(sorted.size() - 1, static_cast<size_t>(p * static_cast<double>(sorted.size())));
+    return sorted[index];
+}
+
+ClientSettings ParseArgs(int argc, char* argv[]) {
+    ClientSettings settings;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string_view arg = argv[i];
+        if (arg == "--socket") {
+            settings.unix_socket_path = argv[i + 1];
+        } else if (arg == "--port") {
+            settings.tcp_port = static_cast<uint16_t>(std::stoul(argv[i + 1]));
+        } else if (arg == "--requests") {
+            settings.requests_path = argv[i + 1];
+        } else if (arg == "--connections") {
+            settings.connections = std::max<size_t>(1, std::stoul(argv[i + 1]));
+        } else if (arg == "--count") {
+            settings.count = std::stoul(argv[i + 1]);
+        } else {
+            throw std::invalid_argument("Unknown argument " + std::string(arg));
+        }
+    }
+    if (settings.requests_path.empty() || (settings.unix_socket_path.empty() && settings.tcp_port == 0)) {
+        throw std::invalid_argument("Usage: load_client (--socket PATH | --port N) --requests FILE [--connections C] [--count N]");
+    }
+    return settings;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    try {
+        const ClientSettings settings = ParseArgs(argc, argv);
+
+        std::vector<std::string> requests;
+        std::ifstream requests_input(settings.requests_path);
+        for (std::string line; std::getline(requests_input, line);) {
+            if (!line.empty()) {
+                requests.push_back(std::move(line));
+            }
+        }
+        if (requests.empty()) {
+            throw std::runtime_error("No requests in " + settings.requests_path);
+        }
+        const size_t total = settings.count != 0 ? settings.count : requests.size();
+
+        std::atomic<size_t> next_request = 0;
+        std::atomic<size_t> errors = 0;
+        std::vector<std::vector<double>> latencies(settings.connections);
+
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (size_t c = 0; c < settings.connections; ++c) {
+            threads.emplace_back([&, c] {
+                int fd = -1;
+                try {
+                    fd = socket_client::Connect(settings.unix_socket_path, settings.tcp_port);
+                } catch (const std::exception& e) {
+                    std::cerr << "Error: " << e.what() << std::endl;
+                    ++errors;
+                    return;
+                }
+                std::string buffer;
+                std::string response;
+                for (size_t i = next_request++; i < total; i = next_request++) {
+                    const std::string& request = requests[i % requests.size()];
+                    const auto request_start = std::chrono::steady_clock::now();
+                    if (!socket_client::SendAll(fd, request) || !socket_client::SendAll(fd, "\n")
+                        || !socket_client::ReadLine(fd, buffer, response)) {
+                        ++errors;
+                        break;
+                    }
+                    const std::chrono::duration<double, std::micro> latency = std::chrono::steady_clock::now() - request_start;
+                    latencies[c].push_back(latency.count());
+                    if (response.find("\"error_message\"") != std::string::npos) {
+                        ++errors;
+                    }
+                }
+                close(fd);
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        std::vector<double> all_latencies;
+        for (const auto& connection_latencies : latencies) {
+            all_latencies.insert(all_latencies.end(), connection_latencies.begin(), connection_latencies.end());
+        }
+        std::sort(all_latencies.begin(), all_latencies.end());
+
+        std::cout << "requests: " << all_latencies.size() << '\n'
+                  << "error responses: " << errors << '\n'
+                  << "connections: " << settings.connections << '\n'
+                  << "elapsed, s: " << elapsed.count() << '\n'
+                  << "throughput, req/s: " << static_cast<double>(all_latencies.size()) / elapsed.count() << '\n'
+                  << "latency p50, us: " << Percentile(all_latencies, 0.50) << '\n'
+                  << "latency p99, us: " << Percentile(all_latencies, 0.99) << '\n'
+                  << "latency max, us: " << (all_latencies.empty() ? 0.0 : all_latencies.back()) << '\n';
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
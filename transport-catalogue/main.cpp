@@ -1,14 +1,253 @@
+#include "format.h"
 #include "json_reader.h"
+#include "profiler.h"
+#include "query_server.h"
+#include "request_metrics.h"
+#include "trace.h"
+#include <pthread.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace {
+
+using namespace std::literals;
+
+std::shared_ptr<const json_reader::TransportBase> LoadBaseFile(json_reader::JsonReader& reader, const std::string& path,
+                                                               const json_reader::TransportBase* previous = nullptr) {
+    std::ifstream base_input(path);
+    if (!base_input) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    const auto base_doc = [&base_input] {
+        profiler::ScopedPhase phase("json.load");
+        profiler::ScopedSubsystem subsystem(profiler::Subsystem::JsonDom);
+        TRACE_SPAN("load", "json.load");
+        return json::Load(base_input);
+    }();
+    return reader.LoadBase(base_doc.GetRoot().AsDict(), previous);
+}
+
+/*
+ * Поток, принимающий управляющие сигналы серверных режимов через sigwait.
+ * Конструктор блокирует сигналы набора в вызывающем потоке, и их наследуют все потоки, созданные после него.
+ * После Start SIGHUP вызывает on_reload, остальные сигналы набора - on_stop, после чего поток завершается
+ */
+class ControlSignalThread {
+public:
+    explicit ControlSignalThread(std::initializer_list<int> stop_signals) {
+        sigemptyset(&signals_);
+        sigaddset(&signals_, SIGHUP);
+        for (int signal : stop_signals) {
+            sigaddset(&signals_, signal);
+        }
+        pthread_sigmask(SIG_BLOCK, &signals_, nullptr);
+    }
+
+    ControlSignalThread(const ControlSignalThread&) = delete;
+    ControlSignalThread& operator=(const ControlSignalThread&) = delete;
+
+    ~ControlSignalThread() {
+        if (thread_.joinable()) {
+            finishing_ = true;
+            pthread_kill(thread_.native_handle(), SIGHUP);
+            thread_.join();
+        }
+    }
+
+    void Start(std::function<void()> on_reload, std::function<void()> on_stop) {
+        on_reload_ = std::move(on_reload);
+        on_stop_ = std::move(on_stop);
+        thread_ = std::thread([this] {
+            Loop();
+        });
+    }
+
+private:
+    void Loop() {
+        int signal = 0;
+        while (sigwait(&signals_, &signal) == 0 && !finishing_) {
+            if (signal != SIGHUP) {
+                on_stop_();
+                return;
+            }
+            on_reload_();
+        }
+    }
+
+    sigset_t signals_;
+    std::function<void()> on_reload_;
+    std::function<void()> on_stop_;
+    std::atomic<bool> finishing_ = false;
+    std::thread thread_;
+};
+
+// Пути отчётов, запрошенных в командной строке; "-" - вывод в stderr
+struct ReportPaths {
+    // Статистика по фазам обработки
+    std::string profile;
+    // Гистограммы задержек по типам запросов
+    std::string request_metrics;
+    // Трасса в формате Chrome trace_event
+    std::string trace;
+    // Учёт памяти по подсистемам
+    std::string memory;
+};
+
+void WriteReport(const std::string& path, const std::function<void(std::ostream&)>& print) {
+    if (path.empty()) {
+        return;
+    }
+    if (path == "-") {
+        print(std::cerr);
+    } else {
+        std::ofstream report(path);
+        print(report);
+    }
+}
+
+// Отчёты выводятся по завершении работы
+void WriteReports(const ReportPaths& paths) {
+    WriteReport(paths.profile, [](std::ostream& output) {
+        profiler::PrintReport(output);
+    });
+    WriteReport(paths.request_metrics, [](std::ostream& output) {
+        format::Writer writer(output);
+        request_metrics::PrintReport(writer);
+        writer.Put('\n');
+    });
+    WriteReport(paths.trace, [](std::ostream& output) {
+        trace::WriteTrace(output);
+    });
+    WriteReport(paths.memory, [](std::ostream& output) {
+        profiler::PrintMemoryReport(output);
+    });
+}
+
+// Учёт памяти по подсистемам выбирается до первого выделения памяти,
+// поэтому без переменной окружения программа перезапускает себя с ней
+void RestartWithMemoryAccounting(char* argv[]) {
+    setenv(profiler::MEMORY_ACCOUNTING_ENV, "1", 1);
+    execv("/proc/self/exe", argv);
+    std::cerr << "Warning: cannot restart with memory accounting, set " << profiler::MEMORY_ACCOUNTING_ENV << "=1" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if (std::find(argv + 1, argv + argc, "--memory-report"sv) != argv + argc && !profiler::IsMemoryAccountingActive()) {
+        RestartWithMemoryAccounting(argv);
+    }
 
-int main() {
     try {
         transport_catalogue::TransportCatalogue catalogue;
         json_reader::JsonReader reader;
+        std::string serve_base_path;
+        query_server::ServerSettings server_settings;
+        ReportPaths report_paths;
+        // Файл для записи запросов режима JSON Lines вместе с ответами
+        std::string record_path;
+        for (int i = 1; i < argc; ++i) {
+            const std::string_view arg = argv[i];
+            if (arg == "--compact") {
+                reader.SetPrintMode(json::PrintMode::Compact);
+            } else if (arg == "--threads" && i + 1 < argc) {
+                server_settings.thread_count = std::stoul(argv[++i]);
+                reader.SetThreadCount(server_settings.thread_count);
+            } else if (arg == "--socket" && i + 1 < argc) {
+                server_settings.unix_socket_path = argv[++i];
+            } else if (arg == "--port" && i + 1 < argc) {
+                server_settings.tcp_port = static_cast<uint16_t>(std::stoul(argv[++i]));
+            } else if (arg == "--serve" && i + 1 < argc) {
+                serve_base_path = argv[++i];
+            } else if (arg == "--profile" && i + 1 < argc) {
+                report_paths.profile = argv[++i];
+                profiler::Enable();
+            } else if (arg == "--perf-counters") {
+                profiler::EnableHardwareCounters();
+                if (const perf_counters::Counters probe; !probe.GetError().empty()) {
+                    std::cerr << "Warning: some hardware counters are unavailable (" << probe.GetError() << ")" << std::endl;
+                }
+            } else if (arg == "--request-stats" && i + 1 < argc) {
+                report_paths.request_metrics = argv[++i];
+                request_metrics::Enable();
+            } else if (arg == "--trace" && i + 1 < argc) {
+                report_paths.trace = argv[++i];
+                trace::Enable();
+                if (!trace::COMPILED_IN) {
+                    std::cerr << "Warning: built without TRANSPORT_CATALOGUE_TRACE, the trace will be empty" << std::endl;
+                }
+            } else if (arg == "--map-cache" && i + 1 < argc) {
+                reader.SetMapCacheDirectory(argv[++i]);
+            } else if (arg == "--record" && i + 1 < argc) {
+                record_path = argv[++i];
+            } else if (arg == "--memory-report" && i + 1 < argc) {
+                report_paths.memory = argv[++i];
+            }
+        }
+
+        if (!serve_base_path.empty()) {
+            // Режим JSON Lines: база загружается из файла один раз, запросы читаются построчно.
+            // Карта отрисовывается по частям, чтобы после перезагрузки отрисовать заново только изменения
+            reader.SetIncrementalMap(true);
+            json_reader::TransportBaseHolder base_holder(LoadBaseFile(reader, serve_base_path));
+
+            std::ofstream record_output;
+            std::optional<request_recorder::RequestRecorder> recorder;
+            if (!record_path.empty()) {
+                record_output.open(record_path);
+                if (!record_output) {
+                    throw std::runtime_error("Cannot open " + record_path);
+                }
+                recorder.emplace(record_output);
+                reader.SetRecorder(&*recorder);
+            }
+
+            // По SIGHUP новая версия базы строится в фоне вместе с картой и подменяет текущую
+            auto reload = [&] {
+                try {
+                    auto base = LoadBaseFile(reader, serve_base_path, base_holder.Get().get());
+                    base->map_cache.Get();
+                    base_holder.Replace(std::move(base));
+                    std::cerr << "Base reloaded from " << serve_base_path << std::endl;
+                } catch (const std::exception& e) {
+                    std::cerr << "Base reload failed: " << e.what() << std::endl;
+                }
+            };
+
+            if (!server_settings.unix_socket_path.empty() || server_settings.tcp_port != 0) {
+                // Те же запросы по локальному сокету, до получения SIGINT или SIGTERM
+                std::unique_ptr<query_server::QueryServer> server;
+                ControlSignalThread control({SIGINT, SIGTERM});
+                server = std::make_unique<query_server::QueryServer>(reader, base_holder, server_settings);
+                control.Start(reload, [&server] {
+                    server->Stop();
+                });
+                server->Run();
+                WriteReports(report_paths);
+                return 0;
+            }
+
+            ControlSignalThread control({});
+            control.Start(reload, [] {});
+            reader.ServeJsonLines(base_holder, std::cin, std::cout);
+            WriteReports(report_paths);
+            return 0;
+        }
+
         reader.ReadJson(std::cin, catalogue, std::cout);
+        WriteReports(report_paths);
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
     }
 
     return 0;
-}
\ No newline at end of file
+}
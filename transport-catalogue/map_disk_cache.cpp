@@ -0,0 +1,268 @@
+#include "map_disk_cache.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <variant>
+#include <stdexcept>
+#include <vector>
+
+namespace map_disk_cache {
+
+namespace {
+
+// Файл, отображённый в память только для чтения; отображение снимается вместе с последней ссылкой на объект
+class MappedFile {
+public:
+    MappedFile(void* data, size_t size)
+        : data_(data)
+        , size_(size) {
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        munmap(data_, size_);
+    }
+
+    std::string_view GetText() const {
+        return {static_cast<const char*>(data_), size_};
+    }
+
+private:
+    void* data_;
+    size_t size_;
+};
+
+void AddStop(ContentHasher& hasher, const transport_catalogue::Stop& stop) {
+    hasher.AddString(stop.name);
+    hasher.AddValue(stop.coord.lat);
+    hasher.AddValue(stop.coord.lng);
+}
+
+// Цвет хэшируется по полям: у Rgba между составляющими и прозрачностью есть байты выравнивания
+void AddColor(ContentHasher& hasher, const svg::Color& color) {
+    hasher.AddValue(color.index());
+    if (const auto* name = std::get_if<std::string>(&color)) {
+        hasher.AddString(*name);
+    } else if (const auto* rgb = std::get_if<svg::Rgb>(&color)) {
+        hasher.AddValue(rgb->red);
+        hasher.AddValue(rgb->green);
+        hasher.AddValue(rgb->blue);
+    } else if (const auto* rgba = std::get_if<svg::Rgba>(&color)) {
+        hasher.AddValue(rgba->red);
+        hasher.AddValue(rgba->green);
+        hasher.AddValue(rgba->blue);
+        hasher.AddValue(rgba->opacity);
+    }
+}
+
+// Эталонная карта задействует все виды элементов и цветов и названия, которые экранируются в SVG.
+// Карта разделяется в месте выделения маршрута так же, как в кэше, и в хэш входят обе части и длина нижней.
+// Почти прямой маршрут "3" при simplify_tolerance больше нуля теряет среднюю вершину
+void HashReferenceMap(ContentHasher& hasher, double simplify_tolerance) {
+    transport_catalogue::TransportCatalogue catalogue;
+    catalogue.AddStop({"A & <B>", {55.611087, 37.20829}});
+    catalogue.AddStop({"C \"D\"", {55.595884, 37.209755}});
+    catalogue.AddStop({"E 'F'", {55.632761, 37.333324}});
+    catalogue.AddStop({"G", {55.622424, 37.270807}});
+
+    transport_catalogue::Bus roundtrip;
+    roundtrip.name = "1";
+    roundtrip.is_roundtrip = true;
+    roundtrip.stops = {catalogue.FindStop("A & <B>"), catalogue.FindStop("C \"D\""), catalogue.FindStop("E 'F'"), catalogue.FindStop("A & <B>")};
+    roundtrip.last_elem = roundtrip.stops.back();
+    catalogue.AddBus(roundtrip);
+
+    transport_catalogue::Bus linear;
+    linear.name = "2к";
+    linear.is_roundtrip = false;
+    linear.stops = {catalogue.FindStop("C \"D\""), catalogue.FindStop("E 'F'"), catalogue.FindStop("C \"D\"")};
+    linear.last_elem = catalogue.FindStop("E 'F'");
+    catalogue.AddBus(linear);
+
+    transport_catalogue::Bus straight;
+    straight.name = "3";
+    straight.is_roundtrip = false;
+    straight.stops = {catalogue.FindStop("A & <B>"), catalogue.FindStop("G"), catalogue.FindStop("E 'F'"),
+                      catalogue.FindStop("G"), catalogue.FindStop("A & <B>")};
+    straight.last_elem = catalogue.FindStop("E 'F'");
+    catalogue.AddBus(straight);
+
+    map_renderer::RenderSettings settings;
+    settings.width = 600.5;
+    settings.height = 400.25;
+    settings.padding = 50;
+    settings.line_width = 14.5;
+    settings.stop_radius = 5;
+    settings.bus_label_font_size = 20;
+    settings.bus_label_offset = {7, 15};
+    settings.stop_label_font_size = 18;
+    settings.stop_label_offset = {7, -3};
+    settings.underlayer_color = svg::Rgba(255, 255, 255, 0.85);
+    settings.underlayer_width = 3;
+    settings.color_palette = {svg::Color{"green"}, svg::Rgb(255, 160, 0)};
+    settings.simplify_tolerance = simplify_tolerance;
+
+    std::string below;
+    std::string above;
+    std::string* part = &below;
+    const map_renderer::MapLayout layout(settings, catalogue);
+    map_renderer::MapRenderer renderer(1);
+    renderer.RenderSvg(layout, [&part](std::string_view chunk) {
+        part->append(chunk);
+    }, [&part, &above](svg::ObjectContainer&) {
+        part = &above;
+    });
+    hasher.AddValue(below.size());
+    hasher.Add(below);
+    hasher.Add(above);
+}
+
+}  // namespace
+
+uint64_t HashCatalogue(const transport_catalogue::TransportCatalogue& catalogue) {
+    // Маршруты перебираются в порядке названий, как на карте, поэтому хэш не зависит от порядка загрузки
+    std::vector<const transport_catalogue::Bus*> buses;
+    for (const auto& [name, bus] : catalogue.GetBusNameToBusMap()) {
+        buses.push_back(bus);
+    }
+    std::sort(buses.begin(), buses.end(), [](const transport_catalogue::Bus* lhs, const transport_catalogue::Bus* rhs) {
+        return lhs->name < rhs->name;
+    });
+
+    ContentHasher hasher;
+    hasher.AddValue(buses.size());
+    for (const auto* bus : buses) {
+        hasher.AddString(bus->name);
+        hasher.AddValue(bus->is_roundtrip);
+        hasher.AddValue(bus->stops.size());
+        for (const auto* stop : bus->stops) {
+            AddStop(hasher, *stop);
+        }
+        hasher.AddValue(bus->last_elem != nullptr);
+        if (bus->last_elem) {
+            AddStop(hasher, *bus->last_elem);
+        }
+    }
+    return hasher.Get();
+}
+
+uint64_t HashRenderSettings(const map_renderer::RenderSettings& settings) {
+    ContentHasher hasher;
+    hasher.AddValue(settings.width);
+    hasher.AddValue(settings.height);
+    hasher.AddValue(settings.padding);
+    hasher.AddValue(settings.line_width);
+    hasher.AddValue(settings.stop_radius);
+    hasher.AddValue(settings.bus_label_font_size);
+    hasher.AddValue(settings.bus_label_offset.first);
+    hasher.AddValue(settings.bus_label_offset.second);
+    hasher.AddValue(settings.stop_label_font_size);
+    hasher.AddValue(settings.stop_label_offset.first);
+    hasher.AddValue(settings.stop_label_offset.second);
+    AddColor(hasher, settings.underlayer_color);
+    hasher.AddValue(settings.underlayer_width);
+    hasher.AddValue(settings.color_palette.size());
+    for (const auto& color : settings.color_palette) {
+        AddColor(hasher, color);
+    }
+    hasher.AddValue(settings.simplify_tolerance);
+    return hasher.Get();
+}
+
+uint64_t HashMapFormat() {
+    static const uint64_t format_hash = [] {
+        ContentHasher hasher;
+        HashReferenceMap(hasher, 0.0);
+        HashReferenceMap(hasher, 10.0);
+        return hasher.Get();
+    }();
+    return format_hash;
+}
+
+MapDiskCache::MapDiskCache(std::string directory)
+    : directory_(std::move(directory)) {
+}
+
+std::optional<SplitMap> MapDiskCache::Load(const MapKey& key) const {
+    const std::string path = GetPath(key);
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return std::nullopt;
+    }
+    struct stat file_stat {};
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size < 2) {
+        close(fd);
+        return std::nullopt;
+    }
+    const auto size = static_cast<size_t>(file_stat.st_size);
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return std::nullopt;
+    }
+
+    auto file = std::make_shared<const MappedFile>(data, size);
+    std::string_view text = file->GetText();
+    const size_t header_end = text.find('\n');
+    if (header_end == std::string_view::npos) {
+        return std::nullopt;
+    }
+    size_t below_size = 0;
+    const auto [header_ptr, header_error] = std::from_chars(text.data(), text.data() + header_end, below_size);
+    text.remove_prefix(header_end + 1);
+    // Обрезанный или испорченный вне программы файл не используется: карта всегда заканчивается закрывающим тегом
+    constexpr std::string_view MAP_END = "</svg>\"";
+    if (header_error != std::errc{} || header_ptr != text.data() - 1 || below_size == 0 || below_size > text.size()
+        || text.front() != '"' || text.size() - below_size < MAP_END.size() || text.substr(text.size() - MAP_END.size()) != MAP_END) {
+        return std::nullopt;
+    }
+    SplitMap map;
+    map.below = json::RawJson(file, text.substr(0, below_size));
+    map.above = std::make_shared<const json::RawJson>(std::move(file), text.substr(below_size));
+    return map;
+}
+
+void MapDiskCache::Store(const MapKey& key, const SplitMap& map) const {
+    static std::atomic<uint64_t> next_temp_id = 0;
+
+    std::error_code error;
+    std::filesystem::create_directories(directory_, error);
+    if (error) {
+        throw std::runtime_error("Cannot create " + directory_ + ": " + error.message());
+    }
+
+    const std::string path = GetPath(key);
+    const std::string temp_path = path + ".tmp." + std::to_string(getpid()) + "." + std::to_string(next_temp_id++);
+    std::ofstream output(temp_path, std::ios::binary);
+    output << map.below.text.size() << '\n';
+    output.write(map.below.text.data(), static_cast<std::streamsize>(map.below.text.size()));
+    output.write(map.above->text.data(), static_cast<std::streamsize>(map.above->text.size()));
+    output.close();
+    if (!output || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        std::remove(temp_path.c_str());
+        throw std::runtime_error("Cannot write " + path);
+    }
+}
+
+std::string MapDiskCache::GetPath(const MapKey& key) const {
+    std::ostringstream path;
+    path << directory_ << "/map-v" << MAP_CACHE_VERSION << '-' << std::hex << std::setfill('0') << std::setw(16) << key.format_hash
+         << '-' << std::setw(16) << key.catalogue_hash << '-' << std::setw(16) << key.settings_hash << ".json";
+    return path.str();
+}
+
+}  // namespace map_disk_cache
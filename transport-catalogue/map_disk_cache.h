@@ -0,0 +1,98 @@
+#pragma once
+
+#include "json.h"
+#include "map_renderer.h"
+#include "transport_catalogue.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace map_disk_cache {
+
+// Версия формата файла кэша: увеличивается при изменении того, как карта записывается в файл.
+// Изменения самого SVG учитываются в ключе через HashMapFormat
+inline constexpr uint32_t MAP_CACHE_VERSION = 2;
+
+// Хэш FNV-1a по байтам. В отличие от std::hash, не меняется между запусками и сборками
+class ContentHasher {
+public:
+    void Add(std::string_view bytes) {
+        for (const unsigned char byte : bytes) {
+            hash_ = (hash_ ^ byte) * PRIME;
+        }
+    }
+
+    template <typename T>
+    void AddValue(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        Add({reinterpret_cast<const char*>(&value), sizeof(value)});
+    }
+
+    // Строка вместе с длиной, чтобы соседние строки не склеивались
+    void AddString(std::string_view text) {
+        AddValue(text.size());
+        Add(text);
+    }
+
+    uint64_t Get() const {
+        return hash_;
+    }
+
+private:
+    static constexpr uint64_t OFFSET_BASIS = 14695981039346656037ull;
+    static constexpr uint64_t PRIME = 1099511628211ull;
+
+    uint64_t hash_ = OFFSET_BASIS;
+};
+
+// Хэш данных справочника, от которых зависит карта: маршруты с названиями, кольцевостью
+// и остановками с их названиями и координатами. Остановки без маршрутов и расстояния на карту не влияют
+uint64_t HashCatalogue(const transport_catalogue::TransportCatalogue& catalogue);
+
+// Хэш настроек отрисовки по их точным значениям
+uint64_t HashRenderSettings(const map_renderer::RenderSettings& settings);
+
+// Хэш SVG эталонной карты, отрисованной текущей сборкой без упрощения линий и с упрощением и разделённой
+// в месте выделения маршрута, как SplitMap: меняется вместе с выводом MapRenderer и местом разделения,
+// поэтому файлы кэша, записанные сборкой с другим выводом, не используются. Вычисляется один раз
+uint64_t HashMapFormat();
+
+// Карта, экранированная строкой JSON, разделённая в месте, куда выводится выделение маршрута запросов RouteMap.
+// below начинается открывающей кавычкой строки, above заканчивается закрывающей; вся карта - below, за которым идёт above
+struct SplitMap {
+    json::RawJson below;
+    std::shared_ptr<const json::RawJson> above;
+};
+
+struct MapKey {
+    uint64_t format_hash;
+    uint64_t catalogue_hash;
+    uint64_t settings_hash;
+};
+
+/*
+ * Кэш отрисованной карты в каталоге: файл с картой, уже экранированной строкой JSON, для каждого ключа.
+ * Файл начинается строкой с длиной нижней части карты, за которой подряд идут обе части.
+ * Файл записывается во временный и переименовывается, поэтому параллельные процессы видят его только целиком.
+ * Загруженный файл отображается в память и разделяется ответами без копирования
+ */
+class MapDiskCache {
+public:
+    explicit MapDiskCache(std::string directory);
+
+    // Пустой результат - карты с таким ключом в кэше нет
+    std::optional<SplitMap> Load(const MapKey& key) const;
+
+    // Исключение std::runtime_error - файл не удалось записать
+    void Store(const MapKey& key, const SplitMap& map) const;
+
+private:
+    std::string GetPath(const MapKey& key) const;
+
+    std::string directory_;
+};
+
+}  // namespace map_disk_cache
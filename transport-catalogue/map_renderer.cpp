@@ -2,162 +2,950 @@
 #include "svg.h"
 #include "transport_catalogue.h"
 #include "geo.h"
+#include "profiler.h"
+#include "trace.h"
 #include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
 #include <iostream>
+#include <limits>
 #include <vector>
 #include <string>
+#include <thread>
+#include <unordered_map>
 
 namespace map_renderer {
-    
+
+// Вывод карты входит в ключ кэша карты на диске через map_disk_cache::HashMapFormat, которая хэширует
+// эталонную карту. Если изменение вывода не затрагивает эталонную карту, её нужно дополнить
+// или увеличить MAP_CACHE_VERSION, иначе будут использоваться файлы кэша со старым выводом
+
 bool IsZero(double value) {
     return std::abs(value) < EPSILON;
 }
-    
-std::string MapRenderer::RenderSvg(const RenderSettings& settings, const transport_catalogue::TransportCatalogue& catalogue) {
-    svg::Document svg_doc;
 
-    std::vector<geo::Coordinates> route_stops;
-    for (const auto& bus : catalogue.GetBuses()) {
-        for (const auto& stop : bus.stops) {
-            route_stops.push_back(stop->GetCoordinates());
+namespace {
+
+// Оценка размеров надписи для отбора в видимую область: средняя ширина символа и выносной элемент в долях кегля.
+// Длина названия берётся в байтах, поэтому для UTF-8 оценка ширины завышена
+constexpr double LABEL_GLYPH_WIDTH = 0.75;
+constexpr double LABEL_DESCENT = 0.25;
+
+// Символы остановок пересадок на выделенном маршруте крупнее обычных
+constexpr double ROUTE_STOP_SCALE = 2.0;
+
+svg::Polyline MakeBusLine(const RenderSettings& settings, size_t bus_index) {
+    svg::Polyline line;
+    line.SetStrokeColor(settings.color_palette[bus_index % settings.color_palette.size()])
+       .SetStrokeWidth(settings.line_width)
+       .SetFillColor(svg::NoneColor)
+       .SetStrokeLineCap(svg::StrokeLineCap::ROUND)
+       .SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+    return line;
+}
+
+// Конечные остановки, у которых выводится название маршрута
+std::vector<const transport_catalogue::Stop*> GetEndStops(const transport_catalogue::Bus& bus) {
+    std::vector<const transport_catalogue::Stop*> end_stops;
+    if (bus.is_roundtrip) {
+        end_stops.push_back(bus.stops.front());
+    } else if (!bus.is_roundtrip && bus.stops.front() != bus.last_elem) {
+        end_stops.push_back(bus.stops.front());
+        end_stops.push_back(bus.last_elem);
+    }
+    else {
+        end_stops.push_back(bus.stops.front());
+    }
+    return end_stops;
+}
+
+void AddBusLabel(svg::ObjectContainer& container, const RenderSettings& settings, size_t bus_index, const std::string& name, svg::Point position) {
+    svg::Text underlayer_text;
+    underlayer_text.SetPosition(position)
+                    .SetOffset(svg::Point{settings.bus_label_offset.first, settings.bus_label_offset.second})
+                    .SetFontSize(settings.bus_label_font_size)
+                    .SetFontFamily("Verdana")
+                    .SetFontWeight("bold")
+                    .SetData(name);
+
+    svg::Color underlayer_color = settings.underlayer_color;
+    underlayer_text.SetFillColor(underlayer_color)
+                    .SetStrokeColor(underlayer_color)
+                    .SetStrokeWidth(settings.underlayer_width)
+                    .SetStrokeLineCap(svg::StrokeLineCap::ROUND)
+                    .SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+
+    svg::Text text;
+    text.SetPosition(position)
+        .SetOffset(svg::Point{settings.bus_label_offset.first, settings.bus_label_offset.second})
+        .SetFontSize(settings.bus_label_font_size)
+        .SetFontFamily("Verdana")
+        .SetFontWeight("bold")
+        .SetData(name)
+        .SetFillColor(settings.color_palette[bus_index % settings.color_palette.size()]);
+
+    container.Add(std::move(underlayer_text));
+    container.Add(std::move(text));
+}
+
+svg::Circle MakeStopPoint(const RenderSettings& settings, svg::Point position) {
+    svg::Circle circle;
+    circle.SetCenter(position)
+          .SetRadius(settings.stop_radius)
+          .SetFillColor("white");
+    return circle;
+}
+
+void AddStopLabel(svg::ObjectContainer& container, const RenderSettings& settings, const std::string& name, svg::Point position) {
+    svg::Text underlayer_text;
+    underlayer_text.SetPosition(position)
+                  .SetOffset(svg::Point{settings.stop_label_offset.first, settings.stop_label_offset.second})
+                  .SetFontSize(settings.stop_label_font_size)
+                  .SetFontFamily("Verdana")
+                  .SetData(name);
+
+    svg::Color underlayer_color = settings.underlayer_color;
+    underlayer_text.SetFillColor(underlayer_color)
+                  .SetStrokeColor(underlayer_color)
+                  .SetStrokeWidth(settings.underlayer_width)
+                  .SetStrokeLineCap(svg::StrokeLineCap::ROUND)
+                  .SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+
+    svg::Text text;
+    text.SetPosition(position)
+        .SetOffset(svg::Point{settings.stop_label_offset.first, settings.stop_label_offset.second})
+        .SetFontSize(settings.stop_label_font_size)
+        .SetFontFamily("Verdana")
+        .SetData(name)
+        .SetFillColor("black");
+
+    container.Add(std::move(underlayer_text));
+    container.Add(std::move(text));
+}
+
+// Оценка рамки надписи с опорной точкой position; ширина текста неизвестна до отрисовки
+MapBox EstimateLabelBox(svg::Point position, std::pair<double, double> offset, int font_size, size_t length, double underlayer_width) {
+    const double x = position.x + offset.first;
+    const double y = position.y + offset.second;
+    const double half_stroke = underlayer_width / 2;
+    return {x - half_stroke, y - font_size - half_stroke,
+            x + LABEL_GLYPH_WIDTH * font_size * static_cast<double>(length) + half_stroke, y + LABEL_DESCENT * font_size + half_stroke};
+}
+
+// Наибольшее удаление рамки от опорной точки по каждой из осей
+double GetBoxReach(const MapBox& box, svg::Point position) {
+    return std::max({position.x - box.min_x, box.max_x - position.x, position.y - box.min_y, box.max_y - position.y});
+}
+
+// Отсекает отрезок from-to прямоугольником box по алгоритму Лянга - Барски.
+// Возвращает доли отрезка [t_begin, t_end], соответствующие видимой части, или пустой результат
+std::optional<std::pair<double, double>> ClipSegment(svg::Point from, svg::Point to, const MapBox& box) {
+    double t_begin = 0.0;
+    double t_end = 1.0;
+    // Ограничение p * t <= q для одной из сторон прямоугольника
+    const auto clip = [&t_begin, &t_end](double p, double q) {
+        if (p == 0.0) {
+            return q >= 0.0;
+        }
+        const double t = q / p;
+        if (p < 0.0) {
+            t_begin = std::max(t_begin, t);
+        } else {
+            t_end = std::min(t_end, t);
+        }
+        return t_begin <= t_end;
+    };
+    const double dx = to.x - from.x;
+    const double dy = to.y - from.y;
+    if (clip(-dx, from.x - box.min_x) && clip(dx, box.max_x - from.x) && clip(-dy, from.y - box.min_y) && clip(dy, box.max_y - from.y)) {
+        return std::pair{t_begin, t_end};
+    }
+    return std::nullopt;
+}
+
+// Точка отрезка from-to на доле t; концы отрезка возвращаются без погрешности
+svg::Point Interpolate(svg::Point from, svg::Point to, double t) {
+    if (t == 0.0) {
+        return from;
+    }
+    if (t == 1.0) {
+        return to;
+    }
+    return {from.x + (to.x - from.x) * t, from.y + (to.y - from.y) * t};
+}
+
+// Значимость вершин ломаной для упрощения Дугласа - Пекера: при допуске t остаются вершины со значимостью больше t.
+// Значимость вершины - расстояние от неё до хорды, на которой она выбрана, но не больше значимости
+// вершины, разбившей объемлющую хорду. Разбиение не зависит от допуска, поэтому одно вычисление годится для любого
+void ComputeSignificance(const svg::Point* points, size_t count, double* significance) {
+    if (count == 0) {
+        return;
+    }
+    constexpr double ENDPOINT = std::numeric_limits<double>::infinity();
+    std::fill(significance, significance + count, 0.0);
+    significance[0] = ENDPOINT;
+    significance[count - 1] = ENDPOINT;
+
+    struct Chord {
+        size_t first;
+        size_t last;
+        double limit;
+    };
+    std::vector<Chord> chords{{0, count - 1, ENDPOINT}};
+    while (!chords.empty()) {
+        const Chord chord = chords.back();
+        chords.pop_back();
+        if (chord.last - chord.first < 2) {
+            continue;
+        }
+
+        const svg::Point a = points[chord.first];
+        const svg::Point b = points[chord.last];
+        const double dx = b.x - a.x;
+        const double dy = b.y - a.y;
+        const double length_sq = dx * dx + dy * dy;
+        size_t farthest = chord.first + 1;
+        double farthest_distance = -1.0;
+        for (size_t i = chord.first + 1; i < chord.last; ++i) {
+            // Расстояние до отрезка, а не до прямой: у маршрута туда и обратно хорда может выродиться в точку
+            const double t = length_sq > 0.0 ? std::clamp(((points[i].x - a.x) * dx + (points[i].y - a.y) * dy) / length_sq, 0.0, 1.0) : 0.0;
+            const double distance = std::hypot(points[i].x - a.x - t * dx, points[i].y - a.y - t * dy);
+            if (distance > farthest_distance) {
+                farthest = i;
+                farthest_distance = distance;
+            }
+        }
+        significance[farthest] = std::min(farthest_distance, chord.limit);
+        chords.push_back({chord.first, farthest, significance[farthest]});
+        chords.push_back({farthest, chord.last, significance[farthest]});
+    }
+}
+
+// Вызывает body(i) для каждого i из [0, count) в thread_count потоках, включая вызывающий.
+// Исключение из body передаётся вызывающему после завершения всех потоков; из нескольких - с наименьшим i
+void RunParallel(size_t thread_count, size_t count, const std::function<void(size_t)>& body) {
+    std::vector<std::exception_ptr> errors(count);
+    std::atomic<size_t> next = 0;
+    auto worker = [&] {
+        for (size_t i = next++; i < count; i = next++) {
+            try {
+                body(i);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < std::min(thread_count, count); ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (const auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+bool IsSamePoint(svg::Point lhs, svg::Point rhs) {
+    return lhs.x == rhs.x && lhs.y == rhs.y;
+}
+
+}  // namespace
+
+// MapLayout
+
+MapLayout::MapLayout(const RenderSettings& settings, const transport_catalogue::TransportCatalogue& catalogue)
+    : settings_(settings) {
+    TRACE_SPAN("map", "map.layout");
+    for (const auto& [name, bus] : catalogue.GetBusNameToBusMap()) {
+        buses_.push_back(bus);
+    }
+    std::sort(buses_.begin(), buses_.end(), [](const transport_catalogue::Bus* lhs, const transport_catalogue::Bus* rhs) {
+        return lhs->name < rhs->name;
+    });
+    for (const auto& [name, stop] : catalogue.GetStopNameToStopMap()) {
+        stops_.push_back(stop);
+    }
+    std::sort(stops_.begin(), stops_.end(), [](const transport_catalogue::Stop* lhs, const transport_catalogue::Stop* rhs) {
+        return lhs->name < rhs->name;
+    });
+
+    std::unordered_map<const transport_catalogue::Stop*, uint32_t> stop_indices;
+    stop_indices.reserve(stops_.size());
+    for (size_t i = 0; i < stops_.size(); ++i) {
+        stop_indices.emplace(stops_[i], static_cast<uint32_t>(i));
+    }
+
+    has_buses_.assign(stops_.size(), false);
+    routes_.reserve(buses_.size());
+    for (const auto* bus : buses_) {
+        Route route;
+        route.begin = static_cast<uint32_t>(route_stops_.size());
+        for (const auto* stop : bus->stops) {
+            const uint32_t index = stop_indices.at(stop);
+            route_stops_.push_back(index);
+            has_buses_[index] = true;
+        }
+        route.end = static_cast<uint32_t>(route_stops_.size());
+        if (!bus->stops.empty()) {
+            for (const auto* stop : GetEndStops(*bus)) {
+                route.end_stops[route.end_stop_count++] = stop_indices.at(stop);
+            }
         }
+        routes_.push_back(route);
     }
 
-    SphereProjector proj(route_stops.begin(), route_stops.end(), 
-                          settings.width, settings.height, 
-                          settings.padding);
+    // Рамка проекции строится по остановкам маршрутов без повторов
+    std::vector<geo::Coordinates> route_coordinates;
+    for (size_t i = 0; i < stops_.size(); ++i) {
+        if (has_buses_[i]) {
+            route_coordinates.push_back(stops_[i]->GetCoordinates());
+        }
+    }
+    proj_ = SphereProjector(route_coordinates.begin(), route_coordinates.end(),
+                            settings_.width, settings_.height,
+                            settings_.padding);
+
+    positions_.reserve(stops_.size());
+    for (const auto* stop : stops_) {
+        positions_.push_back(proj_(stop->GetCoordinates()));
+    }
 
-    std::deque<transport_catalogue::Bus> buses = catalogue.GetBuses();
-    std::sort(buses.begin(), buses.end(), [](const transport_catalogue::Bus& lhs, const transport_catalogue::Bus& rhs) {
-        return lhs.name < rhs.name; 
+    // Значимость не зависит от допуска, поэтому её разделяют полная карта, тайлы и области
+    if (settings_.simplify_tolerance > 0.0) {
+        significance_.resize(route_stops_.size());
+        std::vector<svg::Point> points;
+        for (const Route& route : routes_) {
+            points.clear();
+            for (uint32_t point = route.begin; point < route.end; ++point) {
+                points.push_back(positions_[route_stops_[point]]);
+            }
+            ComputeSignificance(points.data(), points.size(), significance_.data() + route.begin);
+        }
+    }
+}
+
+std::optional<uint32_t> MapLayout::FindBus(std::string_view name) const {
+    const auto it = std::lower_bound(buses_.begin(), buses_.end(), name, [](const transport_catalogue::Bus* bus, std::string_view name) {
+        return bus->name < name;
     });
+    if (it == buses_.end() || (*it)->name != name) {
+        return std::nullopt;
+    }
+    return static_cast<uint32_t>(it - buses_.begin());
+}
 
-    size_t color_count = settings.color_palette.size();
+std::optional<uint32_t> MapLayout::FindStop(std::string_view name) const {
+    const auto it = std::lower_bound(stops_.begin(), stops_.end(), name, [](const transport_catalogue::Stop* stop, std::string_view name) {
+        return stop->name < name;
+    });
+    if (it == stops_.end() || (*it)->name != name) {
+        return std::nullopt;
+    }
+    return static_cast<uint32_t>(it - stops_.begin());
+}
 
-    // Отрисовка линий маршрутов
-    for (size_t i = 0; i < buses.size(); ++i) {
-        const auto& bus = buses[i];
-        if (bus.stops.empty()) {
+// Отрисовка линий маршрутов
+void MapRenderer::RenderBusLines(svg::ObjectContainer& container, const MapLayout& layout, size_t begin, size_t end) const {
+    TRACE_SPAN("map", "svg.bus_lines");
+    profiler::ScopedSubsystem subsystem(profiler::Subsystem::SvgDocument);
+    const RenderSettings& settings = layout.GetSettings();
+    for (size_t i = begin; i < end; ++i) {
+        const MapLayout::Route& route = layout.GetRoute(i);
+        if (route.begin == route.end) {
             continue;
         }
 
-        svg::Polyline line;
-        svg::Color color = settings.color_palette[i % color_count];
-        line.SetStrokeColor(color)
-           .SetStrokeWidth(settings.line_width)
-           .SetFillColor(svg::NoneColor)
-           .SetStrokeLineCap(svg::StrokeLineCap::ROUND)
-           .SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+        svg::Polyline line = MakeBusLine(settings, i);
+        for (uint32_t point = route.begin; point < route.end; ++point) {
+            if (settings.simplify_tolerance <= 0.0 || layout.GetSignificance(point) > settings.simplify_tolerance) {
+                line.AddPoint(layout.GetPosition(layout.GetRouteStop(point)));
+            }
+        }
 
-        for (const auto& stop : bus.stops) {
-            line.AddPoint(proj(stop->GetCoordinates()));
+        container.Add(std::move(line));
+    }
+}
+
+// Отрисовка названий маршрутов
+void MapRenderer::RenderBusLabels(svg::ObjectContainer& container, const MapLayout& layout, size_t begin, size_t end) const {
+    TRACE_SPAN("map", "svg.bus_labels");
+    profiler::ScopedSubsystem subsystem(profiler::Subsystem::SvgDocument);
+    for (size_t i = begin; i < end; ++i) {
+        const MapLayout::Route& route = layout.GetRoute(i);
+        for (uint32_t j = 0; j < route.end_stop_count; ++j) {
+            AddBusLabel(container, layout.GetSettings(), i, layout.GetBuses()[i]->name, layout.GetPosition(route.end_stops[j]));
         }
-        
-        svg_doc.Add(line);
     }
+}
 
-    // Отрисовка названий маршрутов
-    for (size_t i = 0; i < buses.size(); ++i) {
-        const auto& bus = buses[i];
-        if (bus.stops.empty()) {
+// Отрисовка символов остановок
+void MapRenderer::RenderStopPoints(svg::ObjectContainer& container, const MapLayout& layout, size_t begin, size_t end) const {
+    TRACE_SPAN("map", "svg.stop_points");
+    profiler::ScopedSubsystem subsystem(profiler::Subsystem::SvgDocument);
+    for (size_t i = begin; i < end; ++i) {
+        const auto stop = static_cast<uint32_t>(i);
+        if (!layout.HasBuses(stop)) {
             continue;
         }
 
-        std::vector<const transport_catalogue::Stop*> end_stops;
-        if (bus.is_roundtrip) {
-            end_stops.push_back(bus.stops.front()); 
-        } else if (!bus.is_roundtrip && bus.stops.front() != bus.last_elem) {
-            end_stops.push_back(bus.stops.front());
-            end_stops.push_back(bus.last_elem);
+        container.Add(MakeStopPoint(layout.GetSettings(), layout.GetPosition(stop)));
+    }
+}
+
+// Отрисовка названий остановок
+void MapRenderer::RenderStopLabels(svg::ObjectContainer& container, const MapLayout& layout, size_t begin, size_t end) const {
+    TRACE_SPAN("map", "svg.stop_labels");
+    profiler::ScopedSubsystem subsystem(profiler::Subsystem::SvgDocument);
+    for (size_t i = begin; i < end; ++i) {
+        const auto stop = static_cast<uint32_t>(i);
+        if (!layout.HasBuses(stop)) {
+            continue;
         }
-        else {
-            end_stops.push_back(bus.stops.front());
+
+        AddStopLabel(container, layout.GetSettings(), layout.GetStops()[stop]->name, layout.GetPosition(stop));
+    }
+}
+
+MapRenderer::MapRenderer(size_t thread_count)
+    : thread_count_(thread_count) {
+}
+
+std::string MapRenderer::RenderSvg(const RenderSettings& settings, const transport_catalogue::TransportCatalogue& catalogue) {
+    std::string svg_text;
+    RenderSvg(settings, catalogue, [&svg_text](std::string_view chunk) {
+        svg_text.append(chunk);
+    });
+    return svg_text;
+}
+
+void MapRenderer::RenderSvg(const RenderSettings& settings, const transport_catalogue::TransportCatalogue& catalogue, svg::StreamDocument::Sink sink) {
+    RenderSvg(MapLayout(settings, catalogue), std::move(sink));
+}
+
+void MapRenderer::RenderSvg(const MapLayout& layout, svg::StreamDocument::Sink sink) {
+    RenderSvg(layout, std::move(sink), nullptr);
+}
+
+void MapRenderer::RenderSvg(const MapLayout& layout, svg::StreamDocument::Sink sink, const Overlay& overlay) {
+    TRACE_SPAN("map", "map.render_svg");
+
+    svg::StreamDocument svg_doc(std::move(sink));
+    RenderLayers(svg_doc, {
+        {[&](svg::ObjectContainer& container, size_t begin, size_t end) {
+             RenderBusLines(container, layout, begin, end);
+         }, layout.GetBuses().size()},
+    });
+    if (overlay) {
+        overlay(svg_doc);
+    }
+    RenderLayers(svg_doc, {
+        {[&](svg::ObjectContainer& container, size_t begin, size_t end) {
+             RenderBusLabels(container, layout, begin, end);
+         }, layout.GetBuses().size()},
+        {[&](svg::ObjectContainer& container, size_t begin, size_t end) {
+             RenderStopPoints(container, layout, begin, end);
+         }, layout.GetStops().size()},
+        {[&](svg::ObjectContainer& container, size_t begin, size_t end) {
+             RenderStopLabels(container, layout, begin, end);
+         }, layout.GetStops().size()},
+    });
+    svg_doc.Finish();
+}
+
+size_t MapRenderer::GetThreadCount() const {
+    return thread_count_ != 0 ? thread_count_ : std::max(1u, std::thread::hardware_concurrency());
+}
+
+void MapRenderer::RenderLayers(svg::StreamDocument& svg_doc, const std::vector<Layer>& layers) const {
+    const size_t thread_count = GetThreadCount();
+    if (thread_count == 1) {
+        for (const auto& [render_layer, count] : layers) {
+            render_layer(svg_doc, 0, count);
         }
+        return;
+    }
 
-        for (const auto& stop : end_stops) {
-            svg::Text underlayer_text;
-            underlayer_text.SetPosition(proj(stop->GetCoordinates()))
-                            .SetOffset(svg::Point{settings.bus_label_offset.first, settings.bus_label_offset.second})
-                            .SetFontSize(settings.bus_label_font_size)
-                            .SetFontFamily("Verdana")
-                            .SetFontWeight("bold")
-                            .SetData(bus.name);
+    struct LayerChunk {
+        size_t layer;
+        size_t begin;
+        size_t end;
+    };
+    std::vector<LayerChunk> chunks;
+    for (size_t layer = 0; layer < layers.size(); ++layer) {
+        for (size_t begin = 0; begin < layers[layer].second; begin += LAYER_CHUNK_SIZE) {
+            chunks.push_back({layer, begin, std::min(begin + LAYER_CHUNK_SIZE, layers[layer].second)});
+        }
+    }
 
-            svg::Color underlayer_color = settings.underlayer_color;
-            underlayer_text.SetFillColor(underlayer_color)
-                            .SetStrokeColor(underlayer_color)
-                            .SetStrokeWidth(settings.underlayer_width)
-                            .SetStrokeLineCap(svg::StrokeLineCap::ROUND)
-                            .SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+    // Части отрисовываются окнами: потоки разбирают части окна по одной, затем окно выводится по порядку
+    const size_t window = thread_count * LAYER_WINDOW;
+    std::vector<svg::DocumentFragment> fragments(std::min(window, chunks.size()));
+    for (size_t window_begin = 0; window_begin < chunks.size(); window_begin += window) {
+        const size_t window_end = std::min(window_begin + window, chunks.size());
+        RunParallel(thread_count, window_end - window_begin, [&](size_t i) {
+            const LayerChunk& chunk = chunks[window_begin + i];
+            fragments[i].Clear();
+            layers[chunk.layer].first(fragments[i], chunk.begin, chunk.end);
+        });
 
-            svg::Text text;
-            text.SetPosition(proj(stop->GetCoordinates()))
-                .SetOffset(svg::Point{settings.bus_label_offset.first, settings.bus_label_offset.second})
-                .SetFontSize(settings.bus_label_font_size)
-                .SetFontFamily("Verdana")
-                .SetFontWeight("bold")
-                .SetData(bus.name)
-                .SetFillColor(settings.color_palette[i % color_count]);
+        for (size_t i = 0; i < window_end - window_begin; ++i) {
+            svg_doc.AddFragment(fragments[i]);
+        }
+    }
+}
 
-            svg_doc.Add(underlayer_text);
-            svg_doc.Add(text);
+std::shared_ptr<const MapPieces> MapRenderer::RenderPieces(const MapLayout& layout, const MapPieces* previous) const {
+    TRACE_SPAN("map", "map.render_pieces");
+    const RenderSettings& settings = layout.GetSettings();
+    auto pieces = std::make_shared<MapPieces>();
+    pieces->proj_ = layout.GetProjector();
+    // При сдвиге рамки карты сдвигаются все остановки, поэтому части предыдущей версии не сравниваются
+    if (previous != nullptr && !(previous->proj_ == pieces->proj_)) {
+        previous = nullptr;
+    }
+
+    // Номер цвета маршрута; палитра может быть пуста, если ни у одного маршрута нет остановок
+    const auto get_color_index = [&settings](size_t bus) -> size_t {
+        return settings.color_palette.empty() ? 0 : bus % settings.color_palette.size();
+    };
+
+    // Части идут в порядке названий и в предыдущей версии, поэтому часть с тем же названием
+    // ищется одним проходом по ней; position - номер найденной части
+    using Pieces = std::vector<std::shared_ptr<const MapPieces::Piece>>;
+    const auto find_previous = [](const Pieces* previous_pieces, size_t& position, const std::string& name) -> const MapPieces::Piece* {
+        if (previous_pieces == nullptr) {
+            return nullptr;
+        }
+        while (position < previous_pieces->size() && (*previous_pieces)[position]->name < name) {
+            ++position;
+        }
+        if (position < previous_pieces->size() && (*previous_pieces)[position]->name == name) {
+            return (*previous_pieces)[position].get();
+        }
+        return nullptr;
+    };
+
+    std::vector<uint32_t> changed_buses;
+    size_t position = 0;
+    pieces->buses_.resize(layout.GetBuses().size());
+    for (size_t i = 0; i < layout.GetBuses().size(); ++i) {
+        const MapLayout::Route& route = layout.GetRoute(i);
+        const MapPieces::Piece* piece = find_previous(previous ? &previous->buses_ : nullptr, position, layout.GetBuses()[i]->name);
+        bool same = piece != nullptr && piece->color_index == get_color_index(i) && piece->end_stop_count == route.end_stop_count
+            && piece->points.size() == route.end - route.begin + route.end_stop_count;
+        for (uint32_t point = route.begin; same && point < route.end; ++point) {
+            same = IsSamePoint(piece->points[point - route.begin], layout.GetPosition(layout.GetRouteStop(point)));
+        }
+        for (uint32_t j = 0; same && j < route.end_stop_count; ++j) {
+            same = IsSamePoint(piece->points[route.end - route.begin + j], layout.GetPosition(route.end_stops[j]));
+        }
+        if (same) {
+            pieces->buses_[i] = previous->buses_[position];
+        } else {
+            changed_buses.push_back(static_cast<uint32_t>(i));
+        }
+    }
+
+    // Номера остановок, через которые проходят маршруты, в порядке частей
+    std::vector<uint32_t> stops;
+    std::vector<uint32_t> changed_stops;
+    position = 0;
+    for (size_t i = 0; i < layout.GetStops().size(); ++i) {
+        const auto stop = static_cast<uint32_t>(i);
+        if (!layout.HasBuses(stop)) {
+            continue;
+        }
+        const MapPieces::Piece* piece = find_previous(previous ? &previous->stops_ : nullptr, position, layout.GetStops()[stop]->name);
+        if (piece != nullptr && IsSamePoint(piece->points.front(), layout.GetPosition(stop))) {
+            pieces->stops_.push_back(previous->stops_[position]);
+        } else {
+            changed_stops.push_back(static_cast<uint32_t>(pieces->stops_.size()));
+            pieces->stops_.emplace_back();
         }
+        stops.push_back(stop);
     }
 
-    // Отрисовка символов остановок
-    std::deque<transport_catalogue::Stop> all_stops = catalogue.GetStops();
-    std::sort(all_stops.begin(), all_stops.end(), [](const transport_catalogue::Stop& lhs, const transport_catalogue::Stop& rhs) {
-        return lhs.name < rhs.name;
+    // Изменившиеся части отрисовываются по LAYER_CHUNK_SIZE штук на задачу, сначала маршруты, затем остановки
+    const size_t changed_count = changed_buses.size() + changed_stops.size();
+    RunParallel(GetThreadCount(), (changed_count + LAYER_CHUNK_SIZE - 1) / LAYER_CHUNK_SIZE, [&](size_t chunk) {
+        for (size_t k = chunk * LAYER_CHUNK_SIZE; k < std::min(changed_count, (chunk + 1) * LAYER_CHUNK_SIZE); ++k) {
+            auto piece = std::make_shared<MapPieces::Piece>();
+            if (k < changed_buses.size()) {
+                const uint32_t bus = changed_buses[k];
+                const MapLayout::Route& route = layout.GetRoute(bus);
+                piece->name = layout.GetBuses()[bus]->name;
+                piece->color_index = get_color_index(bus);
+                piece->end_stop_count = route.end_stop_count;
+                for (uint32_t point = route.begin; point < route.end; ++point) {
+                    piece->points.push_back(layout.GetPosition(layout.GetRouteStop(point)));
+                }
+                for (uint32_t j = 0; j < route.end_stop_count; ++j) {
+                    piece->points.push_back(layout.GetPosition(route.end_stops[j]));
+                }
+                RenderBusLines(piece->layers[0], layout, bus, bus + 1);
+                RenderBusLabels(piece->layers[1], layout, bus, bus + 1);
+                pieces->buses_[bus] = std::move(piece);
+            } else {
+                const uint32_t index = changed_stops[k - changed_buses.size()];
+                const uint32_t stop = stops[index];
+                piece->name = layout.GetStops()[stop]->name;
+                piece->points.push_back(layout.GetPosition(stop));
+                RenderStopPoints(piece->layers[0], layout, stop, stop + 1);
+                RenderStopLabels(piece->layers[1], layout, stop, stop + 1);
+                pieces->stops_[index] = std::move(piece);
+            }
+        }
     });
 
-    for (const auto& stop : all_stops) {
-        if (catalogue.GetBusesByStop(stop.name).empty()) {
-            continue; 
+    pieces->rendered_count_ = changed_count;
+    pieces->reused_count_ = pieces->buses_.size() + pieces->stops_.size() - changed_count;
+    return pieces;
+}
+
+// MapPieces
+
+void MapPieces::Render(svg::StreamDocument::Sink sink, const MapRenderer::Overlay& overlay) const {
+    TRACE_SPAN("map", "map.render_svg");
+    svg::StreamDocument svg_doc(std::move(sink));
+    for (const auto& piece : buses_) {
+        svg_doc.AddFragment(piece->layers[0]);
+    }
+    if (overlay) {
+        overlay(svg_doc);
+    }
+    for (const auto& piece : buses_) {
+        svg_doc.AddFragment(piece->layers[1]);
+    }
+    for (const auto& piece : stops_) {
+        svg_doc.AddFragment(piece->layers[0]);
+    }
+    for (const auto& piece : stops_) {
+        svg_doc.AddFragment(piece->layers[1]);
+    }
+    svg_doc.Finish();
+}
+
+void RenderRouteOverlay(svg::ObjectContainer& container, const MapLayout& layout, const std::vector<RouteRide>& rides,
+                        const std::vector<std::string_view>& stops) {
+    TRACE_SPAN("map", "map.route_overlay");
+    const RenderSettings& settings = layout.GetSettings();
+
+    // Остановки маршрута автобуса, проеханные на участке: ищется вхождение from, от которого
+    // через span_count перегонов вперёд или назад по маршруту находится to
+    struct RideLine {
+        uint32_t bus;
+        std::vector<svg::Point> points;
+    };
+    std::vector<RideLine> lines;
+    for (const RouteRide& ride : rides) {
+        const auto bus = layout.FindBus(ride.bus);
+        const auto from = layout.FindStop(ride.from);
+        const auto to = layout.FindStop(ride.to);
+        if (!bus || !from || !to) {
+            continue;
         }
+        const MapLayout::Route& route = layout.GetRoute(*bus);
+        const size_t span = ride.span_count;
+        for (size_t i = route.begin; i < route.end; ++i) {
+            if (layout.GetRouteStop(i) != *from) {
+                continue;
+            }
+            int step = 0;
+            if (i + span < route.end && layout.GetRouteStop(i + span) == *to) {
+                step = 1;
+            } else if (i >= route.begin + span && layout.GetRouteStop(i - span) == *to) {
+                step = -1;
+            } else {
+                continue;
+            }
+            RideLine line{*bus, {}};
+            for (size_t k = 0; k <= span; ++k) {
+                line.points.push_back(layout.GetPosition(layout.GetRouteStop(step > 0 ? i + k : i - k)));
+            }
+            lines.push_back(std::move(line));
+            break;
+        }
+    }
 
-        svg::Circle circle;
-        circle.SetCenter(proj(stop.GetCoordinates()))
-              .SetRadius(settings.stop_radius)
-              .SetFillColor("white");
+    // Сначала подложки всех участков, затем сами участки, чтобы подложка не перекрывала пересекающийся участок
+    for (const RideLine& line : lines) {
+        svg::Polyline underlayer;
+        underlayer.SetStrokeColor(settings.underlayer_color)
+                  .SetStrokeWidth(settings.line_width + 2 * settings.underlayer_width)
+                  .SetFillColor(svg::NoneColor)
+                  .SetStrokeLineCap(svg::StrokeLineCap::ROUND)
+                  .SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+        for (const svg::Point point : line.points) {
+            underlayer.AddPoint(point);
+        }
+        container.Add(std::move(underlayer));
+    }
+    for (const RideLine& line : lines) {
+        svg::Polyline polyline = MakeBusLine(settings, line.bus);
+        for (const svg::Point point : line.points) {
+            polyline.AddPoint(point);
+        }
+        container.Add(std::move(polyline));
+    }
 
-        svg_doc.Add(circle);
+    for (const std::string_view name : stops) {
+        if (const auto stop = layout.FindStop(name)) {
+            svg::Circle circle;
+            circle.SetCenter(layout.GetPosition(*stop))
+                  .SetRadius(ROUTE_STOP_SCALE * settings.stop_radius)
+                  .SetFillColor("white")
+                  .SetStrokeColor("black")
+                  .SetStrokeWidth(settings.stop_radius / 2);
+            container.Add(std::move(circle));
+        }
     }
+}
+
+bool IsValidTile(uint32_t zoom, uint32_t x, uint32_t y) {
+    return zoom <= MAX_TILE_ZOOM && x < (1u << zoom) && y < (1u << zoom);
+}
 
-    // Отрисовка названий остановок
-    for (const auto& stop : all_stops) {
-        if (catalogue.GetBusesByStop(stop.name).empty()) {
-            continue; 
+// MapGrid
+
+void MapGrid::Build(double width, double height, const std::vector<MapBox>& boxes) {
+    // Ячеек примерно столько же, сколько элементов
+    const size_t side = std::clamp<size_t>(static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(boxes.size())))), 1, MAX_SIDE);
+    cols_ = side;
+    rows_ = side;
+    cell_width_ = std::max(width, EPSILON) / static_cast<double>(cols_);
+    cell_height_ = std::max(height, EPSILON) / static_cast<double>(rows_);
+
+    // Два прохода: подсчёт элементов по ячейкам, затем раскладка в общий массив
+    cell_begin_.assign(cols_ * rows_ + 1, 0);
+    for (const MapBox& box : boxes) {
+        const auto [col_begin, col_end, row_begin, row_end] = GetCellRange(box);
+        for (size_t row = row_begin; row < row_end; ++row) {
+            for (size_t col = col_begin; col < col_end; ++col) {
+                ++cell_begin_[row * cols_ + col + 1];
+            }
         }
+    }
+    for (size_t cell = 0; cell < cols_ * rows_; ++cell) {
+        cell_begin_[cell + 1] += cell_begin_[cell];
+    }
+
+    items_.resize(cell_begin_.back());
+    std::vector<uint32_t> cell_fill(cell_begin_.begin(), cell_begin_.end() - 1);
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        const auto [col_begin, col_end, row_begin, row_end] = GetCellRange(boxes[i]);
+        for (size_t row = row_begin; row < row_end; ++row) {
+            for (size_t col = col_begin; col < col_end; ++col) {
+                items_[cell_fill[row * cols_ + col]++] = static_cast<uint32_t>(i);
+            }
+        }
+    }
+}
+
+void MapGrid::Query(const MapBox& box, std::vector<uint32_t>& items) const {
+    items.clear();
+    const auto [col_begin, col_end, row_begin, row_end] = GetCellRange(box);
+    for (size_t row = row_begin; row < row_end; ++row) {
+        for (size_t col = col_begin; col < col_end; ++col) {
+            const size_t cell = row * cols_ + col;
+            items.insert(items.end(), items_.begin() + cell_begin_[cell], items_.begin() + cell_begin_[cell + 1]);
+        }
+    }
+    // Элемент, задевающий несколько ячеек, встречается в каждой из них
+    std::sort(items.begin(), items.end());
+    items.erase(std::unique(items.begin(), items.end()), items.end());
+}
+
+std::array<size_t, 4> MapGrid::GetCellRange(const MapBox& box) const {
+    // Элементы за пределами карты попадают в крайние ячейки
+    const auto to_cell = [](double coordinate, double cell_size, size_t count) {
+        return static_cast<size_t>(std::clamp(std::floor(coordinate / cell_size), 0.0, static_cast<double>(count - 1)));
+    };
+    return {to_cell(box.min_x, cell_width_, cols_), to_cell(box.max_x, cell_width_, cols_) + 1,
+            to_cell(box.min_y, cell_height_, rows_), to_cell(box.max_y, cell_height_, rows_) + 1};
+}
+
+// MapIndex
+
+MapIndex::MapIndex(std::shared_ptr<const MapLayout> layout)
+    : layout_(std::move(layout))
+    , settings_(layout_->GetSettings()) {
+    TRACE_SPAN("map", "map.index");
+    line_reach_ = settings_.line_width / 2;
+
+    const auto& buses = layout_->GetBuses();
+    std::vector<MapBox> segment_boxes;
+    std::vector<MapBox> bus_label_boxes;
+    for (size_t i = 0; i < buses.size(); ++i) {
+        const MapLayout::Route& route = layout_->GetRoute(i);
+        if (route.begin == route.end) {
+            continue;
+        }
+
+        // Маршрут из одной остановки хранится вырожденным отрезком, чтобы попасть в тайл
+        const uint32_t last_point = route.end - 1;
+        for (uint32_t point = route.begin; point < std::max(last_point, route.begin + 1); ++point) {
+            const uint32_t end = std::min(point + 1, last_point);
+            const svg::Point from = GetPoint(point);
+            const svg::Point to = GetPoint(end);
+            segments_.push_back({static_cast<uint32_t>(i), point, end});
+            segment_boxes.push_back({std::min(from.x, to.x), std::min(from.y, to.y), std::max(from.x, to.x), std::max(from.y, to.y)});
+        }
+
+        for (uint32_t j = 0; j < route.end_stop_count; ++j) {
+            const uint32_t stop = route.end_stops[j];
+            const svg::Point position = layout_->GetPosition(stop);
+            bus_labels_.push_back({static_cast<uint32_t>(i), stop});
+            bus_label_boxes.push_back({position.x, position.y, position.x, position.y});
+            label_reach_ = std::max(label_reach_, GetBoxReach(EstimateLabelBox(position, settings_.bus_label_offset, settings_.bus_label_font_size,
+                                                                                  buses[i]->name.size(), settings_.underlayer_width), position));
+        }
+    }
+
+    std::vector<MapBox> stop_boxes;
+    const auto& stops = layout_->GetStops();
+    for (size_t i = 0; i < stops.size(); ++i) {
+        const auto stop = static_cast<uint32_t>(i);
+        if (!layout_->HasBuses(stop)) {
+            continue;
+        }
+        const svg::Point position = layout_->GetPosition(stop);
+        stops_.push_back(stop);
+        stop_boxes.push_back({position.x, position.y, position.x, position.y});
+        label_reach_ = std::max(label_reach_, GetBoxReach(EstimateLabelBox(position, settings_.stop_label_offset, settings_.stop_label_font_size,
+                                                                              stops[i]->name.size(), settings_.underlayer_width), position));
+    }
+    label_reach_ = std::max(label_reach_, settings_.stop_radius);
 
-        svg::Text underlayer_text;
-        underlayer_text.SetPosition(proj(stop.GetCoordinates()))
-                      .SetOffset(svg::Point{settings.stop_label_offset.first, settings.stop_label_offset.second})
-                      .SetFontSize(settings.stop_label_font_size)
-                      .SetFontFamily("Verdana")
-                      .SetData(stop.name);
+    segments_grid_.Build(settings_.width, settings_.height, segment_boxes);
+    bus_labels_grid_.Build(settings_.width, settings_.height, bus_label_boxes);
+    stops_grid_.Build(settings_.width, settings_.height, stop_boxes);
+}
+
+void MapIndex::RenderTile(uint32_t zoom, uint32_t x, uint32_t y, svg::StreamDocument::Sink sink) const {
+    TRACE_SPAN("map", "map.tile");
+    // Тайл выводится в размерах всей карты
+    const double scale = static_cast<double>(1u << zoom);
+    RenderView({scale, {x * settings_.width, y * settings_.height}, settings_.width, settings_.height}, std::move(sink));
+}
+
+bool MapIndex::RenderArea(geo::Coordinates south_west, geo::Coordinates north_east, double width, double height, svg::StreamDocument::Sink sink) const {
+    TRACE_SPAN("map", "map.area");
+    const svg::Point top_left = layout_->GetProjector()({north_east.lat, south_west.lng});
+    const svg::Point bottom_right = layout_->GetProjector()({south_west.lat, north_east.lng});
+    const double area_width = bottom_right.x - top_left.x;
+    const double area_height = bottom_right.y - top_left.y;
+    if (!(area_width > EPSILON && area_height > EPSILON && width > 0 && height > 0)) {
+        return false;
+    }
+
+    const double scale = std::min(width / area_width, height / area_height);
+    RenderView({scale, {top_left.x * scale, top_left.y * scale}, area_width * scale, area_height * scale}, std::move(sink));
+    return true;
+}
 
-        svg::Color underlayer_color = settings.underlayer_color;
-        underlayer_text.SetFillColor(underlayer_color)
-                      .SetStrokeColor(underlayer_color)
-                      .SetStrokeWidth(settings.underlayer_width)
-                      .SetStrokeLineCap(svg::StrokeLineCap::ROUND)
-                      .SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+void MapIndex::RenderView(const View& view, svg::StreamDocument::Sink sink) const {
+    const auto to_view = [&view](svg::Point point) {
+        return svg::Point{point.x * view.scale - view.shift.x, point.y * view.scale - view.shift.y};
+    };
+    const auto intersects_view = [&view](const MapBox& box) {
+        return box.max_x >= 0 && box.min_x <= view.width && box.max_y >= 0 && box.min_y <= view.height;
+    };
+    // Видимая часть карты, расширенная на толщину линий или размер надписей
+    const auto map_area = [&view](double reach) {
+        return MapBox{(view.shift.x - reach) / view.scale, (view.shift.y - reach) / view.scale,
+                      (view.shift.x + view.width + reach) / view.scale, (view.shift.y + view.height + reach) / view.scale};
+    };
+
+    svg::StreamDocument svg_doc(std::move(sink));
+    std::vector<uint32_t> items;
+
+    // Подряд идущие видимые отрезки одного маршрута выводятся одной ломаной,
+    // отрезки, выходящие за видимую часть, обрезаются с запасом на толщину линии.
+    // При упрощении отрезок заменяется хордой между ближайшими оставшимися вершинами
+    const double tolerance = settings_.simplify_tolerance;
+    const auto is_kept = [&](uint32_t point) {
+        return tolerance <= 0.0 || layout_->GetSignificance(point) * view.scale > tolerance;
+    };
+    const MapBox clip_box{-line_reach_, -line_reach_, view.width + line_reach_, view.height + line_reach_};
+    constexpr uint32_t NO_POINT = std::numeric_limits<uint32_t>::max();
+    segments_grid_.Query(map_area(line_reach_ + std::max(tolerance, 0.0)), items);
+    std::optional<svg::Polyline> line;
+    uint32_t line_end = NO_POINT;
+    uint32_t chord_begin = NO_POINT;
+    uint32_t chord_end = NO_POINT;
+    for (const uint32_t i : items) {
+        const Segment& segment = segments_[i];
+        // Отрезки одной хорды идут в items подряд, хорда обрабатывается по первому из них
+        if (chord_end != NO_POINT && segment.from >= chord_begin && segment.from < chord_end) {
+            continue;
+        }
+        chord_begin = segment.from;
+        while (!is_kept(chord_begin)) {
+            --chord_begin;
+        }
+        chord_end = segment.to;
+        while (!is_kept(chord_end)) {
+            ++chord_end;
+        }
 
-        svg::Text text;
-        text.SetPosition(proj(stop.GetCoordinates()))
-            .SetOffset(svg::Point{settings.stop_label_offset.first, settings.stop_label_offset.second})
-            .SetFontSize(settings.stop_label_font_size)
-            .SetFontFamily("Verdana")
-            .SetData(stop.name)
-            .SetFillColor("black");
+        const svg::Point from = to_view(GetPoint(chord_begin));
+        const svg::Point to = to_view(GetPoint(chord_end));
+        const auto clipped = ClipSegment(from, to, clip_box);
+        if (!clipped) {
+            continue;
+        }
+        const auto [t_begin, t_end] = *clipped;
+        if (line && (line_end != chord_begin || t_begin != 0.0)) {
+            svg_doc.Add(std::move(*line));
+            line.reset();
+        }
+        if (!line) {
+            line = MakeBusLine(settings_, segment.bus);
+            line->AddPoint(Interpolate(from, to, t_begin));
+        }
+        if (chord_end != chord_begin) {
+            line->AddPoint(Interpolate(from, to, t_end));
+        }
+        line_end = t_end == 1.0 ? chord_end : NO_POINT;
+    }
+    if (line) {
+        svg_doc.Add(std::move(*line));
+    }
 
-        svg_doc.Add(underlayer_text);
-        svg_doc.Add(text);
+    bus_labels_grid_.Query(map_area(label_reach_), items);
+    for (const uint32_t i : items) {
+        const BusLabel& label = bus_labels_[i];
+        const std::string& name = layout_->GetBuses()[label.bus]->name;
+        const svg::Point position = to_view(layout_->GetPosition(label.stop));
+        if (intersects_view(EstimateLabelBox(position, settings_.bus_label_offset, settings_.bus_label_font_size, name.size(), settings_.underlayer_width))) {
+            AddBusLabel(svg_doc, settings_, label.bus, name, position);
+        }
     }
 
-    std::ostringstream svg_stream;
-    svg_doc.Render(svg_stream);
-    return svg_stream.str();
+    stops_grid_.Query(map_area(label_reach_), items);
+    for (const uint32_t i : items) {
+        const svg::Point position = to_view(layout_->GetPosition(stops_[i]));
+        const double radius = settings_.stop_radius;
+        if (intersects_view({position.x - radius, position.y - radius, position.x + radius, position.y + radius})) {
+            svg_doc.Add(MakeStopPoint(settings_, position));
+        }
+    }
+    for (const uint32_t i : items) {
+        const std::string& name = layout_->GetStops()[stops_[i]]->name;
+        const svg::Point position = to_view(layout_->GetPosition(stops_[i]));
+        if (intersects_view(EstimateLabelBox(position, settings_.stop_label_offset, settings_.stop_label_font_size, name.size(), settings_.underlayer_width))) {
+            AddStopLabel(svg_doc, settings_, name, position);
+        }
+    }
+    svg_doc.Finish();
 }
-    
-} // namespace map_renderer
\ No newline at end of file
+
+} // namespace map_renderer
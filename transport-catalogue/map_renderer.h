@@ -1,8 +1,13 @@
 #pragma once
 
 #include <algorithm> 
+#include <array>
 #include <cmath> 
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <optional> 
+#include <string_view>
 #include "geo.h"
 #include "svg.h"
 #include "transport_catalogue.h" 
@@ -17,6 +22,8 @@ bool IsZero(double value);
 
 class SphereProjector {
 public:
+    SphereProjector() = default;
+
     template <typename PointInputIt>
     SphereProjector(PointInputIt points_begin, PointInputIt points_end,
                      double max_width, double max_height, double padding)
@@ -63,8 +70,12 @@ public:
         };
     }
 
+    bool operator==(const SphereProjector& other) const {
+        return padding_ == other.padding_ && min_lon_ == other.min_lon_ && max_lat_ == other.max_lat_ && zoom_coeff_ == other.zoom_coeff_;
+    }
+
 private:
-    double padding_;
+    double padding_ = 0;
     double min_lon_ = 0;
     double max_lat_ = 0;
     double zoom_coeff_ = 0;
@@ -83,11 +94,296 @@ struct RenderSettings {
     svg::Color underlayer_color;
     double underlayer_width;
     std::vector<svg::Color> color_palette;
+    // Допуск упрощения ломаных маршрутов в пикселях изображения; 0 - ломаные не упрощаются
+    double simplify_tolerance = 0.0;
 };
 
+/*
+ * Раскладка карты для одного набора настроек: маршруты и остановки в порядке названий
+ * и положение каждой остановки на карте, вычисленное один раз. Остановки нумеруются в порядке названий,
+ * маршрут хранит номера своих остановок. Раскладку разделяют полная карта, тайлы и области
+ */
+class MapLayout {
+public:
+    using Buses = std::vector<const transport_catalogue::Bus*>;
+    using Stops = std::vector<const transport_catalogue::Stop*>;
+
+    // Остановки маршрута - номера GetRouteStop(i) для i из [begin, end),
+    // и конечные остановки, у которых выводится название маршрута
+    struct Route {
+        uint32_t begin = 0;
+        uint32_t end = 0;
+        std::array<uint32_t, 2> end_stops{};
+        uint32_t end_stop_count = 0;
+    };
+
+    MapLayout(const RenderSettings& settings, const transport_catalogue::TransportCatalogue& catalogue);
+
+    const RenderSettings& GetSettings() const {
+        return settings_;
+    }
+
+    // Проекция, вписывающая в карту все остановки маршрутов
+    const SphereProjector& GetProjector() const {
+        return proj_;
+    }
+
+    const Buses& GetBuses() const {
+        return buses_;
+    }
+
+    const Stops& GetStops() const {
+        return stops_;
+    }
+
+    const Route& GetRoute(size_t bus) const {
+        return routes_[bus];
+    }
+
+    uint32_t GetRouteStop(size_t i) const {
+        return route_stops_[i];
+    }
+
+    size_t GetRouteStopCount() const {
+        return route_stops_.size();
+    }
+
+    svg::Point GetPosition(uint32_t stop) const {
+        return positions_[stop];
+    }
+
+    // Значимость вершины GetRouteStop(i) ломаной маршрута для упрощения Дугласа - Пекера в координатах карты.
+    // Вычисляется, только если simplify_tolerance больше нуля
+    double GetSignificance(size_t i) const {
+        return significance_[i];
+    }
+
+    // Проходит ли через остановку хотя бы один маршрут
+    bool HasBuses(uint32_t stop) const {
+        return has_buses_[stop];
+    }
+
+    // Номер маршрута или остановки по названию; пустой результат - такого нет
+    std::optional<uint32_t> FindBus(std::string_view name) const;
+    std::optional<uint32_t> FindStop(std::string_view name) const;
+
+private:
+    RenderSettings settings_;
+    Buses buses_;
+    Stops stops_;
+    std::vector<Route> routes_;
+    std::vector<uint32_t> route_stops_;
+    std::vector<bool> has_buses_;
+    SphereProjector proj_;
+    std::vector<svg::Point> positions_;
+    std::vector<double> significance_;
+};
+
+class MapPieces;
+
+/*
+ * Отрисовка карты. Слои выводятся по порядку: линии маршрутов, названия маршрутов, символы и названия остановок.
+ * Слои делятся на части по LAYER_CHUNK_SIZE элементов, которые отрисовываются в нескольких потоках
+ * в отдельные буферы и передаются в вывод в исходном порядке. Одновременно в памяти находится
+ * не больше LAYER_WINDOW частей на поток
+ */
 class MapRenderer {
 public:
+    static constexpr size_t LAYER_CHUNK_SIZE = 256;
+    static constexpr size_t LAYER_WINDOW = 8;
+
+    // Число потоков отрисовки; 0 - по числу ядер. В одном потоке элементы передаются в вывод сразу
+    explicit MapRenderer(size_t thread_count = 0);
+
     std::string RenderSvg(const RenderSettings& settings, const transport_catalogue::TransportCatalogue& catalogue);
+
+    // Передаёт SVG-карту в sink фрагментами по мере формирования слоёв, не строя svg::Document
+    void RenderSvg(const RenderSettings& settings, const transport_catalogue::TransportCatalogue& catalogue, svg::StreamDocument::Sink sink);
+
+    // То же по готовой раскладке
+    void RenderSvg(const MapLayout& layout, svg::StreamDocument::Sink sink);
+
+    // Наложение, которое выводится поверх линий маршрутов, под названиями маршрутов и остановками
+    using Overlay = std::function<void(svg::ObjectContainer&)>;
+
+    // То же с наложением; элементы слоёв под ним переданы в sink до вызова overlay
+    void RenderSvg(const MapLayout& layout, svg::StreamDocument::Sink sink, const Overlay& overlay);
+
+    // Отрисовывает карту по частям маршрутов и остановок. Части previous, данные которых не изменились,
+    // используются повторно без отрисовки; previous должна быть отрисована с теми же настройками
+    std::shared_ptr<const MapPieces> RenderPieces(const MapLayout& layout, const MapPieces* previous) const;
+
+private:
+    // Слой: отрисовка элементов с номерами из [begin, end) и число элементов слоя
+    using Layer = std::pair<std::function<void(svg::ObjectContainer&, size_t, size_t)>, size_t>;
+
+    void RenderLayers(svg::StreamDocument& svg_doc, const std::vector<Layer>& layers) const;
+
+    size_t GetThreadCount() const;
+
+    // Слои выводят элементы для маршрутов или остановок с номерами из [begin, end)
+    void RenderBusLines(svg::ObjectContainer& container, const MapLayout& layout, size_t begin, size_t end) const;
+    void RenderBusLabels(svg::ObjectContainer& container, const MapLayout& layout, size_t begin, size_t end) const;
+    void RenderStopPoints(svg::ObjectContainer& container, const MapLayout& layout, size_t begin, size_t end) const;
+    void RenderStopLabels(svg::ObjectContainer& container, const MapLayout& layout, size_t begin, size_t end) const;
+
+    size_t thread_count_;
+};
+
+/*
+ * Карта, отрисованная по частям: у каждого маршрута - линия и названия, у каждой остановки - символ и название.
+ * Часть зависит только от данных своего маршрута или остановки, номера цвета в палитре и проекции,
+ * поэтому следующая версия карты разделяет с предыдущей части, данные которых не изменились.
+ * При сдвиге рамки карты меняется проекция, и все части отрисовываются заново. Вывод совпадает с MapRenderer::RenderSvg
+ */
+class MapPieces {
+public:
+    // Передаёт SVG-карту в sink; overlay выводится в том же месте, что и в MapRenderer::RenderSvg
+    void Render(svg::StreamDocument::Sink sink, const MapRenderer::Overlay& overlay = nullptr) const;
+
+    // Число частей, отрисованных при построении, и число частей, взятых из предыдущей версии
+    size_t GetRenderedCount() const {
+        return rendered_count_;
+    }
+
+    size_t GetReusedCount() const {
+        return reused_count_;
+    }
+
+private:
+    friend class MapRenderer;
+
+    struct Piece {
+        std::string name;
+        // Номер цвета в палитре; у остановок 0
+        size_t color_index = 0;
+        uint32_t end_stop_count = 0;
+        // Положения остановок и конечных остановок маршрута или положение остановки
+        std::vector<svg::Point> points;
+        // Элементы двух слоёв части: линия и названия маршрута или символ и название остановки
+        std::array<svg::DocumentFragment, 2> layers;
+    };
+
+    SphereProjector proj_;
+    // Части маршрутов и остановок, через которые они проходят, в порядке названий
+    std::vector<std::shared_ptr<const Piece>> buses_;
+    std::vector<std::shared_ptr<const Piece>> stops_;
+    size_t rendered_count_ = 0;
+    size_t reused_count_ = 0;
+};
+
+// Участок найденного маршрута, проеханный на автобусе bus от остановки from до остановки to за span_count перегонов
+struct RouteRide {
+    std::string_view bus;
+    std::string_view from;
+    std::string_view to;
+    size_t span_count;
+};
+
+// Выделение найденного маршрута для наложения на карту: проеханные участки линий маршрутов на подложке
+// и увеличенные символы остановок stops. Время отрисовки пропорционально длине маршрута, а не размеру карты
+void RenderRouteOverlay(svg::ObjectContainer& container, const MapLayout& layout, const std::vector<RouteRide>& rides,
+                        const std::vector<std::string_view>& stops);
+
+// Тайлы: на уровне zoom карта делится на 2^zoom x 2^zoom тайлов, тайл (x, y) выводится в размерах всей карты.
+// Координаты элементов масштабируются, а толщины линий, радиусы и шрифты остаются прежними
+inline constexpr uint32_t MAX_TILE_ZOOM = 20;
+
+bool IsValidTile(uint32_t zoom, uint32_t x, uint32_t y);
+
+// Прямоугольник со сторонами, параллельными осям
+struct MapBox {
+    double min_x;
+    double min_y;
+    double max_x;
+    double max_y;
+};
+
+/*
+ * Равномерная сетка над картой width x height: для каждой ячейки хранятся номера элементов,
+ * рамки которых её задевают. Номера всех ячеек лежат в одном массиве подряд
+ */
+class MapGrid {
+public:
+    void Build(double width, double height, const std::vector<MapBox>& boxes);
+
+    // Номера элементов из ячеек, которые задевает box, по возрастанию и без повторов
+    void Query(const MapBox& box, std::vector<uint32_t>& items) const;
+
+private:
+    static constexpr size_t MAX_SIDE = 1024;
+
+    // Диапазоны столбцов и строк ячеек [col_begin, col_end) x [row_begin, row_end)
+    std::array<size_t, 4> GetCellRange(const MapBox& box) const;
+
+    size_t cols_ = 1;
+    size_t rows_ = 1;
+    double cell_width_ = 1.0;
+    double cell_height_ = 1.0;
+    std::vector<uint32_t> cell_begin_;
+    std::vector<uint32_t> items_;
+};
+
+/*
+ * Пространственный индекс карты для отрисовки тайлов и произвольных областей.
+ * Отрезки маршрутов, надписи маршрутов и остановки разложены по сеткам в координатах карты,
+ * поэтому отрисовка области перебирает только элементы своих ячеек. Элементы выводятся
+ * в тех же слоях и в том же порядке, что и в MapRenderer::RenderSvg, линии обрезаются по границе области.
+ * Ломаные упрощаются с допуском simplify_tolerance в пикселях вида по значимости вершин из раскладки.
+ * Надпись попадает в область по оценке её размеров, поэтому у края области возможны лишние надписи
+ */
+class MapIndex {
+public:
+    explicit MapIndex(std::shared_ptr<const MapLayout> layout);
+
+    // Передаёт SVG тайла в sink фрагментами; координаты тайла должны быть допустимы (IsValidTile)
+    void RenderTile(uint32_t zoom, uint32_t x, uint32_t y, svg::StreamDocument::Sink sink) const;
+
+    // Передаёт в sink SVG географической области от south_west до north_east, вписанной без искажений
+    // в изображение width x height. Возвращает false и ничего не выводит, если область пуста
+    bool RenderArea(geo::Coordinates south_west, geo::Coordinates north_east, double width, double height, svg::StreamDocument::Sink sink) const;
+
+private:
+    // Вид на карту: точка карты p выводится в p * scale - shift, видимая часть - [0, width] x [0, height]
+    struct View {
+        double scale;
+        svg::Point shift;
+        double width;
+        double height;
+    };
+
+    void RenderView(const View& view, svg::StreamDocument::Sink sink) const;
+
+    // Отрезок ломаной маршрута bus между вершинами from и to; вершины нумеруются как остановки маршрутов в раскладке
+    struct Segment {
+        uint32_t bus;
+        uint32_t from;
+        uint32_t to;
+    };
+
+    struct BusLabel {
+        uint32_t bus;
+        uint32_t stop;
+    };
+
+    // Положение вершины ломаной в координатах карты
+    svg::Point GetPoint(uint32_t point) const {
+        return layout_->GetPosition(layout_->GetRouteStop(point));
+    }
+
+    std::shared_ptr<const MapLayout> layout_;
+    const RenderSettings& settings_;
+    std::vector<Segment> segments_;
+    std::vector<BusLabel> bus_labels_;
+    // Номера остановок, через которые проходят маршруты, в порядке названий
+    std::vector<uint32_t> stops_;
+    // Насколько линия и надписи с символами остановок выступают за свою опорную точку
+    double line_reach_ = 0.0;
+    double label_reach_ = 0.0;
+
+    MapGrid segments_grid_;
+    MapGrid bus_labels_grid_;
+    MapGrid stops_grid_;
 };
     
 } // map_renderer
\ No newline at end of file
@@ -0,0 +1,195 @@
+#include "perf_counters.h"
+#include "format.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#endif
+
+#include <string_view>
+
+namespace perf_counters {
+
+using namespace std::literals;
+
+namespace {
+
+constexpr std::array<std::string_view, EVENT_COUNT> EVENT_NAMES = {
+    "cycles"sv, "instructions"sv, "l1d_misses"sv, "llc_misses"sv, "branches"sv, "branch_misses"sv};
+
+std::optional<double> Ratio(std::optional<uint64_t> numerator, std::optional<uint64_t> denominator, double scale) {
+    if (!numerator || !denominator || *denominator == 0) {
+        return std::nullopt;
+    }
+    return static_cast<double>(*numerator) * scale / static_cast<double>(*denominator);
+}
+
+#ifdef __linux__
+
+struct EventConfig {
+    uint32_t type;
+    uint64_t config;
+};
+
+constexpr uint64_t L1D_READ_MISS = PERF_COUNT_HW_CACHE_L1D
+                                   | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                   | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+constexpr std::array<EventConfig, EVENT_COUNT> EVENT_CONFIGS = {{
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, L1D_READ_MISS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+}};
+
+int OpenCounter(const EventConfig& event) {
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = event.type;
+    attr.config = event.config;
+    attr.disabled = 1;
+    // Считаются и рабочие потоки, созданные внутри замеряемого интервала
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+// Если счётчиков больше, чем регистров PMU, ядро разделяет их по времени; значение экстраполируется
+std::optional<uint64_t> ReadCounter(int fd) {
+    uint64_t data[3] = {0, 0, 0};
+    if (read(fd, data, sizeof(data)) != static_cast<ssize_t>(sizeof(data)) || data[2] == 0) {
+        return std::nullopt;
+    }
+    if (data[2] == data[1]) {
+        return data[0];
+    }
+    return static_cast<uint64_t>(static_cast<double>(data[0]) * static_cast<double>(data[1]) / static_cast<double>(data[2]));
+}
+
+#endif
+
+}  // namespace
+
+bool Sample::IsEmpty() const {
+    for (const auto& value : values) {
+        if (value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::optional<double> Sample::GetIpc() const {
+    return Ratio(Get(Event::Instructions), Get(Event::Cycles), 1.0);
+}
+
+std::optional<double> Sample::GetL1dMpki() const {
+    return Ratio(Get(Event::L1dMisses), Get(Event::Instructions), 1000.0);
+}
+
+std::optional<double> Sample::GetLlcMpki() const {
+    return Ratio(Get(Event::LlcMisses), Get(Event::Instructions), 1000.0);
+}
+
+std::optional<double> Sample::GetBranchMissRate() const {
+    return Ratio(Get(Event::BranchMisses), Get(Event::Branches), 1.0);
+}
+
+#ifdef __linux__
+
+Counters::Counters() {
+    for (size_t i = 0; i < EVENT_COUNT; ++i) {
+        fds_[i] = OpenCounter(EVENT_CONFIGS[i]);
+        if (fds_[i] < 0 && error_.empty()) {
+            error_ = std::string(EVENT_NAMES[i]) + ": perf_event_open: " + std::strerror(errno);
+        }
+    }
+}
+
+Counters::~Counters() {
+    for (int fd : fds_) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+bool Counters::IsAvailable() const {
+    for (int fd : fds_) {
+        if (fd >= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Counters::Start() {
+    for (int fd : fds_) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+Sample Counters::Stop() {
+    Sample sample;
+    for (size_t i = 0; i < EVENT_COUNT; ++i) {
+        if (fds_[i] >= 0) {
+            ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+            sample.values[i] = ReadCounter(fds_[i]);
+        }
+    }
+    return sample;
+}
+
+#else
+
+Counters::Counters()
+    : error_("perf_event_open is available on Linux only") {
+    fds_.fill(-1);
+}
+
+Counters::~Counters() = default;
+
+bool Counters::IsAvailable() const {
+    return false;
+}
+
+void Counters::Start() {
+}
+
+Sample Counters::Stop() {
+    return {};
+}
+
+#endif
+
+void PrintSample(format::Writer& output, const Sample& sample) {
+    for (size_t i = 0; i < EVENT_COUNT; ++i) {
+        if (sample.values[i]) {
+            output << ", \""sv << EVENT_NAMES[i] << "\": "sv << *sample.values[i];
+        }
+    }
+    const auto print_ratio = [&output](std::string_view name, std::optional<double> value) {
+        if (value) {
+            output << ", \""sv << name << "\": "sv;
+            output.WriteDouble(*value, 4);
+        }
+    };
+    print_ratio("ipc"sv, sample.GetIpc());
+    print_ratio("l1d_mpki"sv, sample.GetL1dMpki());
+    print_ratio("llc_mpki"sv, sample.GetLlcMpki());
+    print_ratio("branch_miss_rate"sv, sample.GetBranchMissRate());
+}
+
+}  // namespace perf_counters
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace format {
+class Writer;
+}  // namespace format
+
+namespace perf_counters {
+
+// Аппаратные события процессора, считаемые через perf_event_open
+enum class Event {
+    Cycles,
+    Instructions,
+    L1dMisses,
+    LlcMisses,
+    Branches,
+    BranchMisses,
+};
+
+inline constexpr size_t EVENT_COUNT = 6;
+
+// Значения счётчиков за интервал; пустое значение - счётчик недоступен
+struct Sample {
+    std::array<std::optional<uint64_t>, EVENT_COUNT> values;
+
+    std::optional<uint64_t> Get(Event event) const {
+        return values[static_cast<size_t>(event)];
+    }
+
+    bool IsEmpty() const;
+
+    // Инструкций за такт
+    std::optional<double> GetIpc() const;
+    // Промахов на тысячу инструкций
+    std::optional<double> GetL1dMpki() const;
+    std::optional<double> GetLlcMpki() const;
+    // Доля неверно предсказанных переходов
+    std::optional<double> GetBranchMissRate() const;
+};
+
+/*
+ * Набор счётчиков текущего потока и потоков, созданных им после Start.
+ * Поддерживается только в Linux. Счётчики, которые не удалось открыть (нет PMU в виртуальной машине,
+ * запрет perf_event_paranoid, другая ОС), пропускаются, и остальные продолжают работать
+ */
+class Counters {
+public:
+    Counters();
+
+    Counters(const Counters&) = delete;
+    Counters& operator=(const Counters&) = delete;
+
+    ~Counters();
+
+    // Открыт ли хотя бы один счётчик
+    bool IsAvailable() const;
+
+    // Причина, по которой не открылся первый из недоступных счётчиков
+    const std::string& GetError() const {
+        return error_;
+    }
+
+    void Start();
+    Sample Stop();
+
+private:
+    std::array<int, EVENT_COUNT> fds_;
+    std::string error_;
+};
+
+// Дописывает доступные счётчики и производные метрики полями JSON-словаря: , "cycles": ...
+void PrintSample(format::Writer& output, const Sample& sample);
+
+}  // namespace perf_counters
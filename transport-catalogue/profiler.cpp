@@ -0,0 +1,292 @@
+#include "profiler.h"
+#include "format.h"
+
+#include <sys/resource.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <ctime>
+#include <limits>
+#include <mutex>
+#include <new>
+
+namespace profiler {
+
+namespace {
+
+std::atomic<bool> enabled = false;
+std::atomic<bool> hardware_counters_enabled = false;
+std::atomic<uint64_t> allocation_count = 0;
+std::atomic<uint64_t> allocated_bytes = 0;
+
+std::mutex phases_mutex;
+std::vector<PhaseStats> phases;
+
+constexpr std::array<const char*, SUBSYSTEM_COUNT> SUBSYSTEM_NAMES = {
+    "other", "json_dom", "stop_distances", "stop_to_buses", "graph_edges", "router_matrix", "svg_document",
+    "map_index"};
+
+struct SubsystemCounters {
+    std::atomic<int64_t> live_bytes = 0;
+    std::atomic<int64_t> peak_bytes = 0;
+    std::atomic<uint64_t> allocations = 0;
+    std::atomic<uint64_t> allocated_bytes = 0;
+};
+
+std::array<SubsystemCounters, SUBSYSTEM_COUNT> subsystem_counters;
+thread_local Subsystem current_subsystem = Subsystem::Other;
+
+enum class AccountingState {
+    Unknown,
+    Inactive,
+    Active,
+};
+
+std::atomic<AccountingState> accounting_state = AccountingState::Unknown;
+
+// Заголовок блока сохраняет выравнивание, гарантированное operator new
+struct alignas(alignof(std::max_align_t)) BlockHeader {
+    uint64_t size;
+    Subsystem subsystem;
+};
+
+bool AccountingActive() {
+    AccountingState state = accounting_state.load(std::memory_order_relaxed);
+    if (state == AccountingState::Unknown) {
+        // getenv не выделяет память, поэтому может вызываться из operator new
+        const char* value = std::getenv(MEMORY_ACCOUNTING_ENV);
+        state = value != nullptr && *value != '\0' && *value != '0' ? AccountingState::Active : AccountingState::Inactive;
+        accounting_state.store(state, std::memory_order_relaxed);
+    }
+    return state == AccountingState::Active;
+}
+
+void AccountAllocation(BlockHeader& header, size_t size) {
+    header.size = size;
+    header.subsystem = current_subsystem;
+    SubsystemCounters& counters = subsystem_counters[static_cast<size_t>(header.subsystem)];
+    counters.allocations.fetch_add(1, std::memory_order_relaxed);
+    counters.allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    const int64_t live = counters.live_bytes.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed) + static_cast<int64_t>(size);
+    int64_t peak = counters.peak_bytes.load(std::memory_order_relaxed);
+    while (live > peak && !counters.peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+}
+
+void AccountDeallocation(const BlockHeader& header) {
+    subsystem_counters[static_cast<size_t>(header.subsystem)].live_bytes.fetch_sub(static_cast<int64_t>(header.size), std::memory_order_relaxed);
+}
+
+// Выделяет память, как стандартный operator new: пока malloc не справляется, вызывает установленный
+// std::new_handler и повторяет попытку, а без обработчика выбрасывает std::bad_alloc
+void* Allocate(std::size_t size) {
+    while (true) {
+        if (void* ptr = std::malloc(size)) {
+            return ptr;
+        }
+        const std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+int64_t WallNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int64_t CpuNanoseconds() {
+    timespec ts{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+}
+
+uint64_t PeakRssKb() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<uint64_t>(usage.ru_maxrss);
+}
+
+}  // namespace
+
+void Enable() {
+    enabled = true;
+}
+
+bool IsEnabled() {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+void EnableHardwareCounters() {
+    hardware_counters_enabled = true;
+}
+
+bool AreHardwareCountersEnabled() {
+    return hardware_counters_enabled.load(std::memory_order_relaxed);
+}
+
+uint64_t GetAllocationCount() {
+    return allocation_count.load(std::memory_order_relaxed);
+}
+
+uint64_t GetAllocatedBytes() {
+    return allocated_bytes.load(std::memory_order_relaxed);
+}
+
+std::vector<PhaseStats> GetPhases() {
+    std::lock_guard lock(phases_mutex);
+    return phases;
+}
+
+void PrintReport(std::ostream& output) {
+    using namespace std::literals;
+    // Отчёт пишется напрямую, так как json::Node не вмещает 64-битные счётчики
+    format::Writer out(output);
+    out << "{\"phases\": ["sv;
+    bool first = true;
+    for (const auto& phase : GetPhases()) {
+        out << (first ? "\n    "sv : ",\n    "sv);
+        first = false;
+        out << "{\"name\": \""sv;
+        out.WriteJsonEscaped(phase.name);
+        out << "\", \"wall_ms\": "sv;
+        out.WriteDouble(phase.wall_ms, 9);
+        out << ", \"cpu_ms\": "sv;
+        out.WriteDouble(phase.cpu_ms, 9);
+        out << ", \"allocations\": "sv << phase.allocations
+            << ", \"allocated_bytes\": "sv << phase.allocated_bytes
+            << ", \"peak_rss_kb\": "sv << phase.peak_rss_kb;
+        perf_counters::PrintSample(out, phase.counters);
+        out.Put('}');
+    }
+    out << "\n]}\n"sv;
+}
+
+bool IsMemoryAccountingActive() {
+    return AccountingActive();
+}
+
+std::vector<SubsystemMemory> GetSubsystemMemory() {
+    std::vector<SubsystemMemory> result(SUBSYSTEM_COUNT);
+    for (size_t i = 0; i < SUBSYSTEM_COUNT; ++i) {
+        const SubsystemCounters& counters = subsystem_counters[i];
+        result[i].name = SUBSYSTEM_NAMES[i];
+        result[i].live_bytes = counters.live_bytes.load(std::memory_order_relaxed);
+        result[i].peak_bytes = counters.peak_bytes.load(std::memory_order_relaxed);
+        result[i].allocations = counters.allocations.load(std::memory_order_relaxed);
+        result[i].allocated_bytes = counters.allocated_bytes.load(std::memory_order_relaxed);
+    }
+    return result;
+}
+
+void PrintMemoryReport(std::ostream& output) {
+    using namespace std::literals;
+    format::Writer out(output);
+    out << "{\"subsystems\": ["sv;
+    bool first = true;
+    for (const auto& subsystem : GetSubsystemMemory()) {
+        out << (first ? "\n    "sv : ",\n    "sv);
+        first = false;
+        out << "{\"name\": \""sv << subsystem.name
+            << "\", \"live_bytes\": "sv << subsystem.live_bytes
+            << ", \"peak_bytes\": "sv << subsystem.peak_bytes
+            << ", \"allocations\": "sv << subsystem.allocations
+            << ", \"allocated_bytes\": "sv << subsystem.allocated_bytes << '}';
+    }
+    out << "\n]}\n"sv;
+}
+
+ScopedSubsystem::ScopedSubsystem(Subsystem subsystem)
+    : previous_(current_subsystem) {
+    current_subsystem = subsystem;
+}
+
+ScopedSubsystem::~ScopedSubsystem() {
+    current_subsystem = previous_;
+}
+
+ScopedPhase::ScopedPhase(const char* name)
+    : name_(name)
+    , active_(IsEnabled()) {
+    if (active_) {
+        wall_start_ns_ = WallNanoseconds();
+        cpu_start_ns_ = CpuNanoseconds();
+        allocations_start_ = GetAllocationCount();
+        allocated_bytes_start_ = GetAllocatedBytes();
+        if (AreHardwareCountersEnabled()) {
+            counters_ = std::make_unique<perf_counters::Counters>();
+            counters_->Start();
+        }
+    }
+}
+
+ScopedPhase::~ScopedPhase() {
+    if (!active_) {
+        return;
+    }
+    PhaseStats stats;
+    if (counters_) {
+        stats.counters = counters_->Stop();
+    }
+    stats.name = name_;
+    stats.wall_ms = static_cast<double>(WallNanoseconds() - wall_start_ns_) / 1e6;
+    stats.cpu_ms = static_cast<double>(CpuNanoseconds() - cpu_start_ns_) / 1e6;
+    stats.allocations = GetAllocationCount() - allocations_start_;
+    stats.allocated_bytes = GetAllocatedBytes() - allocated_bytes_start_;
+    stats.peak_rss_kb = PeakRssKb();
+
+    std::lock_guard lock(phases_mutex);
+    phases.push_back(std::move(stats));
+}
+
+}  // namespace profiler
+
+// Глобальные operator new/delete считают выделения памяти, пока сбор статистики включён,
+// а при учёте памяти по подсистемам добавляют к каждому блоку заголовок
+
+void* operator new(std::size_t size) {
+    if (profiler::IsEnabled()) {
+        profiler::allocation_count.fetch_add(1, std::memory_order_relaxed);
+        profiler::allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    if (profiler::AccountingActive()) {
+        // Размер с заголовком не должен переполниться и превратиться в маленький блок
+        if (size > std::numeric_limits<std::size_t>::max() - sizeof(profiler::BlockHeader)) {
+            throw std::bad_alloc();
+        }
+        auto* header = static_cast<profiler::BlockHeader*>(profiler::Allocate(sizeof(profiler::BlockHeader) + size));
+        profiler::AccountAllocation(*header, size);
+        return header + 1;
+    }
+    return profiler::Allocate(size == 0 ? 1 : size);
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    if (ptr != nullptr && profiler::AccountingActive()) {
+        auto* header = static_cast<profiler::BlockHeader*>(ptr) - 1;
+        profiler::AccountDeallocation(*header);
+        std::free(header);
+        return;
+    }
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+    operator delete(ptr);
+}
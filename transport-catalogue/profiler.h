@@ -0,0 +1,123 @@
+#pragma once
+
+#include "perf_counters.h"
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace profiler {
+
+struct PhaseStats {
+    std::string name;
+    double wall_ms = 0.0;
+    // Процессорное время и выделения памяти считаются по всему процессу (CLOCK_PROCESS_CPUTIME_ID и общие счётчики),
+    // а не по потокам фазы. Если параллельно с фазой работают другие потоки, например отрисовка карты внутри
+    // call_once в одном потоке пула, пока остальные обрабатывают запросы, их работа попадает в фазу
+    double cpu_ms = 0.0;
+    uint64_t allocations = 0;
+    uint64_t allocated_bytes = 0;
+    // Пиковый размер резидентной памяти процесса на момент окончания фазы
+    uint64_t peak_rss_kb = 0;
+    // Аппаратные счётчики фазы, если они включены и доступны
+    perf_counters::Sample counters;
+};
+
+// Включает сбор статистики фаз и подсчёт выделений памяти. По умолчанию сбор выключен
+void Enable();
+bool IsEnabled();
+
+// Включает замер аппаратных счётчиков процессора (perf_event_open) в каждой фазе
+void EnableHardwareCounters();
+bool AreHardwareCountersEnabled();
+
+// Число и суммарный размер выделений через operator new с момента включения сбора
+uint64_t GetAllocationCount();
+uint64_t GetAllocatedBytes();
+
+std::vector<PhaseStats> GetPhases();
+
+// Подсистемы, память которых учитывается отдельно
+enum class Subsystem {
+    Other,
+    JsonDom,
+    StopDistances,
+    StopToBuses,
+    GraphEdges,
+    RouterMatrix,
+    SvgDocument,
+    MapIndex,
+};
+
+inline constexpr size_t SUBSYSTEM_COUNT = 8;
+
+// Переменная окружения, включающая учёт памяти по подсистемам
+inline constexpr const char* MEMORY_ACCOUNTING_ENV = "TRANSPORT_CATALOGUE_MEMORY_ACCOUNTING";
+
+struct SubsystemMemory {
+    const char* name = nullptr;
+    // Память, выделенная в подсистеме и ещё не освобождённая
+    int64_t live_bytes = 0;
+    int64_t peak_bytes = 0;
+    uint64_t allocations = 0;
+    uint64_t allocated_bytes = 0;
+};
+
+/*
+ * Учёт памяти по подсистемам включается переменной окружения MEMORY_ACCOUNTING_ENV
+ * и решается при первом выделении памяти: каждому блоку добавляется заголовок с подсистемой и размером,
+ * поэтому режим нельзя переключить после запуска
+ */
+bool IsMemoryAccountingActive();
+
+std::vector<SubsystemMemory> GetSubsystemMemory();
+
+// Выводит учёт памяти по подсистемам в формате JSON
+void PrintMemoryReport(std::ostream& output);
+
+// Выводит собранную статистику фаз в формате JSON
+void PrintReport(std::ostream& output);
+
+/*
+ * Замеряет фазу от создания объекта до его разрушения.
+ * При выключенном сборе ничего не делает. Вложенные фазы учитываются и в объемлющей
+ */
+class ScopedPhase {
+public:
+    explicit ScopedPhase(const char* name);
+
+    ScopedPhase(const ScopedPhase&) = delete;
+    ScopedPhase& operator=(const ScopedPhase&) = delete;
+
+    ~ScopedPhase();
+
+private:
+    const char* name_;
+    bool active_ = false;
+    int64_t wall_start_ns_ = 0;
+    int64_t cpu_start_ns_ = 0;
+    uint64_t allocations_start_ = 0;
+    uint64_t allocated_bytes_start_ = 0;
+    std::unique_ptr<perf_counters::Counters> counters_;
+};
+
+/*
+ * Относит выделения памяти текущего потока к подсистеме до разрушения объекта.
+ * Освобождение учитывается в той подсистеме, где блок был выделен. Вложенная область замещает объемлющую
+ */
+class ScopedSubsystem {
+public:
+    explicit ScopedSubsystem(Subsystem subsystem);
+
+    ScopedSubsystem(const ScopedSubsystem&) = delete;
+    ScopedSubsystem& operator=(const ScopedSubsystem&) = delete;
+
+    ~ScopedSubsystem();
+
+private:
+    Subsystem previous_;
+};
+
+}  // namespace profiler
@@ -0,0 +1,324 @@
+#include "query_server.h"
+#include "format.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace query_server {
+
+namespace {
+
+[[noreturn]] void ThrowSystemError(const char* what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+void SetNonBlocking(int fd) {
+    const int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        ThrowSystemError("fcntl");
+    }
+}
+
+}  // namespace
+
+QueryServer::QueryServer(const json_reader::JsonReader& reader, const json_reader::TransportBaseHolder& base_holder, ServerSettings settings)
+    : reader_(reader)
+    , base_holder_(base_holder)
+    , settings_(std::move(settings)) {
+    if (pipe(wake_pipe_) < 0) {
+        ThrowSystemError("pipe");
+    }
+    SetNonBlocking(wake_pipe_[0]);
+    SetNonBlocking(wake_pipe_[1]);
+    OpenListener();
+    pool_ = std::make_unique<thread_pool::ThreadPool>(settings_.thread_count);
+}
+
+QueryServer::~QueryServer() {
+    // Сначала дожидаемся задач пула, которые ещё могут обращаться к соединениям
+    pool_.reset();
+    for (const auto& [fd, connection] : connections_) {
+        close(fd);
+    }
+    if (listen_fd_ >= 0) {
+        close(listen_fd_);
+        if (!settings_.unix_socket_path.empty()) {
+            unlink(settings_.unix_socket_path.c_str());
+        }
+    }
+    close(wake_pipe_[0]);
+    close(wake_pipe_[1]);
+}
+
+void QueryServer::OpenListener() {
+    if (!settings_.unix_socket_path.empty()) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (settings_.unix_socket_path.size() >= sizeof(address.sun_path)) {
+            throw std::runtime_error("Socket path is too long: " + settings_.unix_socket_path);
+        }
+        std::strcpy(address.sun_path, settings_.unix_socket_path.c_str());
+
+        listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd_ < 0) {
+            ThrowSystemError("socket");
+        }
+        unlink(settings_.unix_socket_path.c_str());
+        if (bind(listen_fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+            ThrowSystemError("bind");
+        }
+    } else {
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(settings_.tcp_port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        if (listen_fd_ < 0) {
+            ThrowSystemError("socket");
+        }
+        const int reuse = 1;
+        setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (bind(listen_fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+            ThrowSystemError("bind");
+        }
+    }
+    if (listen(listen_fd_, SOMAXCONN) < 0) {
+        ThrowSystemError("listen");
+    }
+    SetNonBlocking(listen_fd_);
+}
+
+void QueryServer::Run() {
+    std::vector<pollfd> fds;
+    while (!stopping_) {
+        fds.clear();
+        fds.push_back({listen_fd_, 0, 0});
+        fds.push_back({wake_pipe_[0], POLLIN, 0});
+        {
+            std::lock_guard lock(connections_mutex_);
+            for (auto it = connections_.begin(); it != connections_.end();) {
+                Connection& connection = *it->second;
+                if (connection.busy) {
+                    ++it;
+                } else if (connection.closed) {
+                    close(connection.fd);
+                    it = connections_.erase(it);
+                    // Освободился дескриптор, поэтому отложенный приём соединений можно повторить
+                    accept_paused_ = false;
+                } else if (connection.output_begin < connection.output.size()) {
+                    // Ответы дописываются, когда клиент освободит место в сокете
+                    fds.push_back({connection.fd, POLLOUT, 0});
+                    ++it;
+                } else if (connection.ready) {
+                    // Оставшиеся запросы обрабатываются без ожидания новых данных
+                    connection.busy = true;
+                    pool_->Submit([this, &connection] {
+                        ServeConnection(connection);
+                    });
+                    ++it;
+                } else {
+                    fds.push_back({connection.fd, POLLIN, 0});
+                    ++it;
+                }
+            }
+        }
+
+        if (!accept_paused_) {
+            fds[0].events = POLLIN;
+        }
+        const int ready_count = poll(fds.data(), fds.size(), accept_paused_ ? ACCEPT_RETRY_MS : -1);
+        if (ready_count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ThrowSystemError("poll");
+        }
+        if (ready_count == 0) {
+            accept_paused_ = false;
+        }
+
+        if (fds[1].revents != 0) {
+            char buffer[64];
+            while (read(wake_pipe_[0], buffer, sizeof(buffer)) > 0) {
+            }
+        }
+        if (fds[0].revents & POLLIN) {
+            AcceptConnections();
+        }
+
+        std::lock_guard lock(connections_mutex_);
+        for (size_t i = 2; i < fds.size(); ++i) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+            Connection* connection = connections_.at(fds[i].fd).get();
+            connection->busy = true;
+            pool_->Submit([this, connection] {
+                ServeConnection(*connection);
+            });
+        }
+    }
+}
+
+void QueryServer::Stop() {
+    stopping_ = true;
+    Wake();
+}
+
+void QueryServer::Wake() {
+    const char byte = 0;
+    [[maybe_unused]] const ssize_t written = write(wake_pipe_[1], &byte, 1);
+}
+
+void QueryServer::AcceptConnections() {
+    while (true) {
+        const int fd = accept(listen_fd_, nullptr, nullptr);
+        if (fd < 0) {
+            // EINTR - прерванный вызов, ECONNABORTED и EPROTO - ошибки одного соединения, которое уже убрано из очереди
+            if (errno == EINTR || errno == ECONNABORTED || errno == EPROTO) {
+                continue;
+            }
+            // EAGAIN - очередь входящих соединений пуста
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            }
+            // EMFILE, ENFILE, ENOBUFS, ENOMEM и прочие ошибки оставляют соединение в очереди: приём откладывается
+            // до закрытия одного из соединений или на ACCEPT_RETRY_MS, чтобы не опрашивать сокет непрерывно
+            if (!accept_error_reported_) {
+                std::cerr << "Warning: cannot accept connection: " << std::strerror(errno) << std::endl;
+                accept_error_reported_ = true;
+            }
+            accept_paused_ = true;
+            return;
+        }
+        SetNonBlocking(fd);
+
+        auto connection = std::make_unique<Connection>();
+        connection->fd = fd;
+        std::lock_guard lock(connections_mutex_);
+        connections_.emplace(fd, std::move(connection));
+    }
+}
+
+void QueryServer::ServeConnection(Connection& connection) {
+    bool alive = SendOutput(connection);
+    // Пока клиент не принял прежние ответы, новые запросы не читаются
+    if (alive && connection.output_begin == connection.output.size()) {
+        if (!connection.eof) {
+            ReadInput(connection);
+        }
+        ProcessInput(connection);
+        alive = SendOutput(connection);
+    }
+    const bool finished = connection.eof && !connection.ready && connection.output_begin == connection.output.size();
+
+    {
+        std::lock_guard lock(connections_mutex_);
+        connection.closed = connection.closed || !alive || finished;
+        connection.busy = false;
+    }
+    Wake();
+}
+
+void QueryServer::ReadInput(Connection& connection) {
+    char buffer[64 * 1024];
+    while (connection.input.size() < MAX_INPUT_SIZE) {
+        const ssize_t received = recv(connection.fd, buffer, std::min(sizeof(buffer), MAX_INPUT_SIZE - connection.input.size()), 0);
+        if (received > 0) {
+            connection.input.append(buffer, static_cast<size_t>(received));
+            connection.input_chunks.push_back({connection.input.size(), std::chrono::steady_clock::now()});
+        } else if (received < 0 && errno == EINTR) {
+            continue;
+        } else {
+            // Ноль означает, что клиент закрыл соединение, EAGAIN - что данные закончились
+            connection.eof = received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+            return;
+        }
+    }
+}
+
+void QueryServer::ProcessInput(Connection& connection) {
+    const auto base = base_holder_.Get();
+    if (connection.output_begin == connection.output.size()) {
+        connection.output.clear();
+        connection.output_begin = 0;
+    }
+
+    format::Writer writer(connection.output);
+    std::string_view input = connection.input;
+    size_t begin = 0;
+    connection.ready = false;
+    // Время получения порции, в которой закончилась строка [.., end)
+    auto chunk = connection.input_chunks.begin();
+    const auto arrival = [&](size_t end) {
+        while (chunk->end < end) {
+            ++chunk;
+        }
+        return chunk->time;
+    };
+    for (size_t end = input.find('\n'); end != std::string_view::npos; end = input.find('\n', begin)) {
+        // Остальные запросы ждут, пока клиент примет накопленные ответы
+        if (connection.output.size() - connection.output_begin >= MAX_OUTPUT_SIZE) {
+            connection.ready = true;
+            break;
+        }
+        const std::string_view line = input.substr(begin, end - begin);
+        if (line.size() > MAX_LINE_SIZE) {
+            connection.closed = true;
+            break;
+        }
+        if (!json_reader::JsonReader::IsBlankLine(line)) {
+            reader_.ProcessJsonLine(*base, line, writer, arrival(end + 1));
+        }
+        begin = end + 1;
+    }
+
+    const std::string_view rest = input.substr(begin);
+    if (!connection.ready && !connection.closed) {
+        if (rest.size() > MAX_LINE_SIZE) {
+            connection.closed = true;
+        } else if (connection.eof && !json_reader::JsonReader::IsBlankLine(rest)) {
+            // Последний запрос перед закрытием соединения может быть без перевода строки
+            reader_.ProcessJsonLine(*base, rest, writer, arrival(input.size()));
+            begin = input.size();
+        }
+    }
+    connection.input.erase(0, begin);
+    while (!connection.input_chunks.empty() && connection.input_chunks.front().end <= begin) {
+        connection.input_chunks.pop_front();
+    }
+    for (InputChunk& input_chunk : connection.input_chunks) {
+        input_chunk.end -= begin;
+    }
+}
+
+bool QueryServer::SendOutput(Connection& connection) {
+    while (connection.output_begin < connection.output.size()) {
+        const ssize_t sent = send(connection.fd, connection.output.data() + connection.output_begin,
+                                  connection.output.size() - connection.output_begin, MSG_NOSIGNAL);
+        if (sent > 0) {
+            connection.output_begin += static_cast<size_t>(sent);
+        } else if (sent < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+    }
+    return true;
+}
+
+}  // namespace query_server
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "json_reader.h"
+#include "thread_pool.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace query_server {
+
+struct ServerSettings {
+    // Путь к Unix domain сокету; если пуст, используется TCP-порт на 127.0.0.1
+    std::string unix_socket_path;
+    uint16_t tcp_port = 0;
+    // Число потоков обработки запросов; 0 - по числу ядер
+    size_t thread_count = 0;
+};
+
+/*
+ * Сервер запросов к загруженной базе по локальному сокету.
+ * Протокол - JSON Lines: клиент пишет по одному запросу stat_requests в строке,
+ * сервер отвечает по одной строке на каждый запрос в том же порядке.
+ * Один поток ожидает событий на всех соединениях через poll, чтение и обработка
+ * запросов выполняются в пуле потоков. Соединение одновременно обслуживает не более одного потока.
+ * Каждая порция запросов обрабатывается на версии базы, актуальной на момент её получения.
+ * Поток пула не ждёт клиента: ответы, которые соединение не приняло, остаются в соединении и
+ * дописываются, когда poll сообщит о готовности к записи. Пока они не отправлены, новые запросы соединения
+ * не читаются и не обрабатываются, поэтому клиент, не читающий ответы, не занимает поток и не расходует память
+ */
+class QueryServer {
+public:
+    // Наибольшая длина строки запроса; соединение с более длинной строкой закрывается
+    static constexpr size_t MAX_LINE_SIZE = 1 << 20;
+    // Наибольший объём прочитанных, но не обработанных данных соединения
+    static constexpr size_t MAX_INPUT_SIZE = 4 << 20;
+    // Обработка запросов соединения прерывается, когда неотправленные ответы превышают этот объём
+    static constexpr size_t MAX_OUTPUT_SIZE = 4 << 20;
+    // Через сколько миллисекунд повторяется приём соединений, отложенный из-за нехватки дескрипторов или памяти
+    static constexpr int ACCEPT_RETRY_MS = 1000;
+
+    QueryServer(const json_reader::JsonReader& reader, const json_reader::TransportBaseHolder& base_holder, ServerSettings settings);
+
+    QueryServer(const QueryServer&) = delete;
+    QueryServer& operator=(const QueryServer&) = delete;
+
+    ~QueryServer();
+
+    // Обслуживает соединения до вызова Stop
+    void Run();
+
+    // Может вызываться из другого потока и из обработчика сигнала
+    void Stop();
+
+private:
+    // Порция входных данных, полученная одним recv: заканчивается перед байтом end буфера input
+    struct InputChunk {
+        size_t end;
+        std::chrono::steady_clock::time_point time;
+    };
+
+    struct Connection {
+        int fd = -1;
+        std::string input;
+        // Моменты получения порций input; момент поступления запроса - получение порции с его последним байтом
+        std::deque<InputChunk> input_chunks;
+        // Ответы; клиенту ещё не отправлены байты начиная с output_begin
+        std::string output;
+        size_t output_begin = 0;
+        bool busy = false;
+        // Во входных данных остались полные строки, обработка которых прервана из-за объёма ответов
+        bool ready = false;
+        // Клиент закончил передачу запросов
+        bool eof = false;
+        bool closed = false;
+    };
+
+    void OpenListener();
+    void AcceptConnections();
+    void ServeConnection(Connection& connection);
+    void ReadInput(Connection& connection);
+    void ProcessInput(Connection& connection);
+    // Отправляет накопленные ответы, пока сокет принимает данные; false - соединение разорвано
+    bool SendOutput(Connection& connection);
+    void Wake();
+
+    const json_reader::JsonReader& reader_;
+    const json_reader::TransportBaseHolder& base_holder_;
+    ServerSettings settings_;
+
+    int listen_fd_ = -1;
+    // Приём соединений отложен: соединение осталось в очереди, и poll сообщал бы о нём непрерывно.
+    // Ошибка приёма выводится один раз за работу сервера. Оба поля использует только поток Run
+    bool accept_paused_ = false;
+    bool accept_error_reported_ = false;
+    int wake_pipe_[2] = {-1, -1};
+    std::atomic<bool> stopping_ = false;
+
+    std::mutex connections_mutex_;
+    std::map<int, std::unique_ptr<Connection>> connections_;
+
+    std::unique_ptr<thread_pool::ThreadPool> pool_;
+};
+
+}  // namespace query_server
@@ -0,0 +1,330 @@
+// Воспроизведение потока запросов, записанного флагом --record в режиме JSON Lines.
+// Запросы выполняются либо в этом же процессе через JsonReader::ProcessJsonLine на базе из файла,
+// либо на запущенном сервере через сокет. Ответы сравниваются с записанными,
+// в конце выводятся пропускная способность, задержки и расхождения.
+//
+// Использование:
+//   replay --record FILE (--base base.json | --socket PATH | --port N) [--workers W]
+//          [--rate R | --speed X] [--count N] [--max-diffs K]
+
+#include "json.h"
+#include "json_reader.h"
+#include "socket_client.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct ReplaySettings {
+    std::string record_path;
+    std::string base_path;
+    std::string unix_socket_path;
+    uint16_t tcp_port = 0;
+    // Число параллельных исполнителей: потоков или соединений с сервером
+    size_t workers = 1;
+    // Фиксированная частота запросов в секунду; 0 - без ограничения
+    double rate = 0.0;
+    // Множитель скорости относительно записанных интервалов; 0 - интервалы не соблюдаются
+    double speed = 0.0;
+    size_t count = 0;
+    size_t max_diffs = 10;
+};
+
+struct RecordedRequest {
+    double time = 0.0;
+    std::string request;
+    std::string response;
+    // Ответы на запросы Stats зависят от момента запроса и не сравниваются
+    bool comparable = true;
+};
+
+std::vector<RecordedRequest> LoadRecord(const std::string& path) {
+    std::ifstream input(path);
+    if (!input) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    std::vector<RecordedRequest> records;
+    for (std::string line; std::getline(input, line);) {
+        if (json_reader::JsonReader::IsBlankLine(line)) {
+            continue;
+        }
+        std::istringstream line_stream(line);
+        const auto record_doc = json::Load(line_stream);
+        const auto& record = record_doc.GetRoot().AsDict();
+
+        RecordedRequest recorded;
+        recorded.time = record.at("time").AsDouble();
+        recorded.request = record.at("request").AsString();
+        recorded.response = record.at("response").AsString();
+        try {
+            std::istringstream request_stream(recorded.request);
+            const auto request_doc = json::Load(request_stream);
+            const auto& request = request_doc.GetRoot().AsDict();
+            const auto type_it = request.find("type");
+            recorded.comparable = type_it == request.end() || !type_it->second.IsString() || type_it->second.AsString() != "Stats";
+        } catch (const std::exception&) {
+            // Неразобранный запрос сравнивается по тексту ошибки
+        }
+        records.push_back(std::move(recorded));
+    }
+    if (records.empty()) {
+        throw std::runtime_error("No requests in " + path);
+    }
+    // Записи идут в порядке завершения обработки, а воспроизводятся в порядке поступления
+    std::stable_sort(records.begin(), records.end(), [](const RecordedRequest& lhs, const RecordedRequest& rhs) {
+        return lhs.time < rhs.time;
+    });
+    return records;
+}
+
+// Исполнитель запросов одного потока воспроизведения
+class Session {
+public:
+    virtual ~Session() = default;
+
+    // Выполняет запрос и возвращает ответ без перевода строки; false - исполнитель больше не может работать
+    virtual bool Execute(std::string_view request, std::string& response) = 0;
+};
+
+class LocalSession : public Session {
+public:
+    LocalSession(const json_reader::JsonReader& reader, const json_reader::TransportBase& base)
+        : reader_(reader)
+        , base_(base) {
+    }
+
+    bool Execute(std::string_view request, std::string& response) override {
+        response.clear();
+        {
+            format::Writer writer(response);
+            reader_.ProcessJsonLine(base_, request, writer, std::chrono::steady_clock::now());
+        }
+        response.pop_back();
+        return true;
+    }
+
+private:
+    const json_reader::JsonReader& reader_;
+    const json_reader::TransportBase& base_;
+};
+
+class SocketSession : public Session {
+public:
+    explicit SocketSession(const ReplaySettings& settings)
+        : fd_(socket_client::Connect(settings.unix_socket_path, settings.tcp_port)) {
+    }
+
+    SocketSession(const SocketSession&) = delete;
+    SocketSession& operator=(const SocketSession&) = delete;
+
+    ~SocketSession() override {
+        close(fd_);
+    }
+
+    bool Execute(std::string_view request, std::string& response) override {
+        request_line_.assign(request);
+        request_line_.push_back('\n');
+        return socket_client::SendAll(fd_, request_line_) && socket_client::ReadLine(fd_, buffer_, response);
+    }
+
+private:
+    int fd_;
+    std::string buffer_;
+    std::string request_line_;
+};
+
+// Смещение момента отправки запроса index от начала воспроизведения; пустое - отправлять сразу
+std::optional<Clock::duration> GetScheduledOffset(const ReplaySettings& settings, const std::vector<RecordedRequest>& records, size_t index) {
+    std::chrono::duration<double> offset{};
+    if (settings.rate > 0.0) {
+        offset = std::chrono::duration<double>(static_cast<double>(index) / settings.rate);
+    } else if (settings.speed > 0.0) {
+        // При повторе записи по кругу каждый круг сдвигается на длительность записи
+        const double span = records.back().time - records.front().time;
+        const size_t cycle = index / records.size();
+        const double time = static_cast<double>(cycle) * span + records[index % records.size()].time - records.front().time;
+        offset = std::chrono::duration<double>(time / settings.speed);
+    } else {
+        return std::nullopt;
+    }
+    return std::chrono::duration_cast<Clock::duration>(offset);
+}
+
+// Первое различие ответов с контекстом вокруг него
+void PrintDiff(std::ostream& output, size_t index, const RecordedRequest& recorded, const std::string& actual) {
+    constexpr size_t CONTEXT = 60;
+    const auto [expected_it, actual_it] = std::mismatch(recorded.response.begin(), recorded.response.end(), actual.begin(), actual.end());
+    const size_t position = static_cast<size_t>(expected_it - recorded.response.begin());
+    const size_t begin = position > CONTEXT ? position - CONTEXT : 0;
+    output << "diff in request #" << index << ": " << recorded.request << '\n'
+           << "  at offset " << position << '\n'
+           << "  expected: ..." << recorded.response.substr(begin, 2 * CONTEXT) << "...\n"
+           << "  actual:   ..." << actual.substr(begin, 2 * CONTEXT) << "...\n";
+}
+
+double Percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    const size_t index = std::min(sorted.size() - 1, static_cast<size_t>(p * static_cast<double>(sorted.size())));
+    return sorted[index];
+}
+
+ReplaySettings ParseArgs(int argc, char* argv[]) {
+    ReplaySettings settings;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string_view arg = argv[i];
+        const std::string value = argv[i + 1];
+        if (arg == "--record") {
+            settings.record_path = value;
+        } else if (arg == "--base") {
+            settings.base_path = value;
+        } else if (arg == "--socket") {
+            settings.unix_socket_path = value;
+        } else if (arg == "--port") {
+            settings.tcp_port = static_cast<uint16_t>(std::stoul(value));
+        } else if (arg == "--workers") {
+            settings.workers = std::max<size_t>(1, std::stoul(value));
+        } else if (arg == "--rate") {
+            settings.rate = std::stod(value);
+        } else if (arg == "--speed") {
+            settings.speed = std::stod(value);
+        } else if (arg == "--count") {
+            settings.count = std::stoul(value);
+        } else if (arg == "--max-diffs") {
+            settings.max_diffs = std::stoul(value);
+        } else {
+            throw std::invalid_argument("Unknown argument " + std::string(arg));
+        }
+    }
+    const int targets = !settings.base_path.empty() + !settings.unix_socket_path.empty() + (settings.tcp_port != 0);
+    if (settings.record_path.empty() || targets != 1 || (settings.rate > 0.0 && settings.speed > 0.0)) {
+        throw std::invalid_argument("Usage: replay --record FILE (--base base.json | --socket PATH | --port N) [--workers W] "
+                                    "[--rate R | --speed X] [--count N] [--max-diffs K]");
+    }
+    return settings;
+}
+
+std::unique_ptr<json_reader::TransportBase> LoadBase(json_reader::JsonReader& reader, const std::string& path) {
+    std::ifstream input(path);
+    if (!input) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    const auto doc = json::Load(input);
+    auto base = reader.LoadBase(doc.GetRoot().AsDict());
+    // Карта отрисовывается заранее, чтобы не попасть в задержку первого запроса Map
+    base->map_cache.Get();
+    return base;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    try {
+        const ReplaySettings settings = ParseArgs(argc, argv);
+        const std::vector<RecordedRequest> records = LoadRecord(settings.record_path);
+        const size_t total = settings.count != 0 ? settings.count : records.size();
+
+        json_reader::JsonReader reader;
+        std::unique_ptr<json_reader::TransportBase> base;
+        if (!settings.base_path.empty()) {
+            base = LoadBase(reader, settings.base_path);
+        }
+
+        std::atomic<size_t> next_request = 0;
+        std::atomic<size_t> errors = 0;
+        std::atomic<size_t> mismatches = 0;
+        std::mutex diff_mutex;
+        size_t printed_diffs = 0;
+        std::vector<std::vector<double>> latencies(settings.workers);
+
+        const Clock::time_point start = Clock::now();
+        std::vector<std::thread> threads;
+        for (size_t w = 0; w < settings.workers; ++w) {
+            threads.emplace_back([&, w] {
+                std::unique_ptr<Session> session;
+                try {
+                    if (base) {
+                        session = std::make_unique<LocalSession>(reader, *base);
+                    } else {
+                        session = std::make_unique<SocketSession>(settings);
+                    }
+                } catch (const std::exception& e) {
+                    std::cerr << "Error: " << e.what() << std::endl;
+                    ++errors;
+                    return;
+                }
+
+                std::string response;
+                for (size_t i = next_request++; i < total; i = next_request++) {
+                    const RecordedRequest& recorded = records[i % records.size()];
+                    // Задержка отсчитывается от запланированного момента отправки,
+                    // поэтому отставание от расписания тоже попадает в неё
+                    Clock::time_point request_start = Clock::now();
+                    if (const auto offset = GetScheduledOffset(settings, records, i)) {
+                        request_start = start + *offset;
+                        std::this_thread::sleep_until(request_start);
+                    }
+                    if (!session->Execute(recorded.request, response)) {
+                        ++errors;
+                        break;
+                    }
+                    const std::chrono::duration<double, std::micro> latency = Clock::now() - request_start;
+                    latencies[w].push_back(latency.count());
+
+                    if (recorded.comparable && response != recorded.response) {
+                        ++mismatches;
+                        std::lock_guard lock(diff_mutex);
+                        if (printed_diffs < settings.max_diffs) {
+                            ++printed_diffs;
+                            PrintDiff(std::cout, i % records.size(), recorded, response);
+                        }
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        const std::chrono::duration<double> elapsed = Clock::now() - start;
+
+        std::vector<double> all_latencies;
+        for (const auto& worker_latencies : latencies) {
+            all_latencies.insert(all_latencies.end(), worker_latencies.begin(), worker_latencies.end());
+        }
+        std::sort(all_latencies.begin(), all_latencies.end());
+
+        std::cout << "requests: " << all_latencies.size() << '\n'
+                  << "mismatched responses: " << mismatches << '\n'
+                  << "errors: " << errors << '\n'
+                  << "workers: " << settings.workers << '\n'
+                  << "elapsed, s: " << elapsed.count() << '\n'
+                  << "throughput, req/s: " << static_cast<double>(all_latencies.size()) / elapsed.count() << '\n'
+                  << "latency p50, us: " << Percentile(all_latencies, 0.50) << '\n'
+                  << "latency p99, us: " << Percentile(all_latencies, 0.99) << '\n'
+                  << "latency p999, us: " << Percentile(all_latencies, 0.999) << '\n'
+                  << "latency max, us: " << (all_latencies.empty() ? 0.0 : all_latencies.back()) << '\n';
+        return mismatches == 0 && errors == 0 ? 0 : 1;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,168 @@
+#include "request_metrics.h"
+#include "format.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace request_metrics {
+
+using namespace std::literals;
+
+namespace {
+
+struct TypeMetrics {
+    LatencyHistogram latency_ns;
+    std::atomic<uint64_t> not_found = 0;
+};
+
+constexpr std::array<std::string_view, 7> TYPE_NAMES = {"Bus"sv, "Stop"sv, "Route"sv, "Map"sv, "MapTile"sv, "RouteMap"sv, "Other"sv};
+
+std::atomic<bool> enabled = false;
+std::array<TypeMetrics, TYPE_NAMES.size()> metrics;
+
+size_t GetTypeIndex(std::string_view type) {
+    const auto it = std::find(TYPE_NAMES.begin(), TYPE_NAMES.end() - 1, type);
+    return static_cast<size_t>(it - TYPE_NAMES.begin());
+}
+
+void UpdateMin(std::atomic<uint64_t>& target, uint64_t value) {
+    uint64_t current = target.load(std::memory_order_relaxed);
+    while (value < current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+void UpdateMax(std::atomic<uint64_t>& target, uint64_t value) {
+    uint64_t current = target.load(std::memory_order_relaxed);
+    while (value > current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+}  // namespace
+
+size_t LatencyHistogram::GetBucketIndex(uint64_t value) {
+    if (value < SUB_BUCKET_COUNT) {
+        return static_cast<size_t>(value);
+    }
+    const int msb = 63 - __builtin_clzll(value);
+    const uint64_t group = static_cast<uint64_t>(msb - SUB_BUCKET_BITS + 1);
+    const uint64_t sub_bucket = (value >> (msb - SUB_BUCKET_BITS)) & (SUB_BUCKET_COUNT - 1);
+    return static_cast<size_t>(group * SUB_BUCKET_COUNT + sub_bucket);
+}
+
+uint64_t LatencyHistogram::GetBucketLowerBound(size_t index) {
+    if (index < SUB_BUCKET_COUNT) {
+        return index;
+    }
+    const uint64_t group = index / SUB_BUCKET_COUNT;
+    const uint64_t sub_bucket = index % SUB_BUCKET_COUNT;
+    return (SUB_BUCKET_COUNT + sub_bucket) << (group - 1);
+}
+
+uint64_t LatencyHistogram::GetBucketUpperBound(size_t index) {
+    if (index < SUB_BUCKET_COUNT) {
+        return index;
+    }
+    const uint64_t group = index / SUB_BUCKET_COUNT;
+    return GetBucketLowerBound(index) + ((uint64_t{1} << (group - 1)) - 1);
+}
+
+void LatencyHistogram::Record(uint64_t value) {
+    buckets_[GetBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+    UpdateMin(min_, value);
+    UpdateMax(max_, value);
+}
+
+uint64_t LatencyHistogram::GetCount() const {
+    return count_.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::GetMin() const {
+    return GetCount() == 0 ? 0 : min_.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::GetMax() const {
+    return max_.load(std::memory_order_relaxed);
+}
+
+double LatencyHistogram::GetMean() const {
+    const uint64_t count = GetCount();
+    return count == 0 ? 0.0 : static_cast<double>(sum_.load(std::memory_order_relaxed)) / static_cast<double>(count);
+}
+
+uint64_t LatencyHistogram::GetValueAtPercentile(double percentile) const {
+    const uint64_t count = GetCount();
+    if (count == 0) {
+        return 0;
+    }
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(percentile / 100.0 * static_cast<double>(count))));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        seen += buckets_[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return std::min(GetBucketUpperBound(i), GetMax());
+        }
+    }
+    return GetMax();
+}
+
+void LatencyHistogram::PrintTo(format::Writer& output) const {
+    output << "{\"count\":"sv << GetCount()
+           << ",\"min\":"sv << GetMin()
+           << ",\"mean\":"sv << GetMean()
+           << ",\"p50\":"sv << GetValueAtPercentile(50.0)
+           << ",\"p90\":"sv << GetValueAtPercentile(90.0)
+           << ",\"p99\":"sv << GetValueAtPercentile(99.0)
+           << ",\"p999\":"sv << GetValueAtPercentile(99.9)
+           << ",\"max\":"sv << GetMax()
+           << ",\"buckets\":["sv;
+    // Непустые корзины в виде пар [нижняя граница, число значений]
+    bool first = true;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        const uint64_t bucket_count = buckets_[i].load(std::memory_order_relaxed);
+        if (bucket_count == 0) {
+            continue;
+        }
+        if (!first) {
+            output.Put(',');
+        }
+        first = false;
+        output << '[' << GetBucketLowerBound(i) << ',' << bucket_count << ']';
+    }
+    output << "]}"sv;
+}
+
+void Enable() {
+    enabled = true;
+}
+
+bool IsEnabled() {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+void Record(std::string_view type, uint64_t latency_ns, bool not_found) {
+    TypeMetrics& type_metrics = metrics[GetTypeIndex(type)];
+    type_metrics.latency_ns.Record(latency_ns);
+    if (not_found) {
+        type_metrics.not_found.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void PrintReport(format::Writer& output) {
+    output.Put('{');
+    for (size_t i = 0; i < TYPE_NAMES.size(); ++i) {
+        if (i != 0) {
+            output.Put(',');
+        }
+        const TypeMetrics& type_metrics = metrics[i];
+        output << '"' << TYPE_NAMES[i] << "\":{\"count\":"sv << type_metrics.latency_ns.GetCount()
+               << ",\"not_found\":"sv << type_metrics.not_found.load(std::memory_order_relaxed)
+               << ",\"latency_ns\":"sv;
+        type_metrics.latency_ns.PrintTo(output);
+        output.Put('}');
+    }
+    output.Put('}');
+}
+
+}  // namespace request_metrics
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+
+namespace format {
+class Writer;
+}  // namespace format
+
+namespace request_metrics {
+
+/*
+ * Гистограмма задержек с логарифмически-линейными корзинами (в духе HdrHistogram):
+ * каждая степень двойки делится на SUB_BUCKET_COUNT равных корзин, что даёт относительную
+ * погрешность не более 1/16. Запись потокобезопасна и не требует блокировок
+ */
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 4;
+    static constexpr uint64_t SUB_BUCKET_COUNT = uint64_t{1} << SUB_BUCKET_BITS;
+    static constexpr size_t BUCKET_COUNT = 64 * SUB_BUCKET_COUNT;
+
+    void Record(uint64_t value);
+
+    uint64_t GetCount() const;
+    uint64_t GetMin() const;
+    uint64_t GetMax() const;
+    double GetMean() const;
+
+    // Верхняя граница корзины, в которую попадает значение заданного перцентиля (0..100)
+    uint64_t GetValueAtPercentile(double percentile) const;
+
+    // Выводит статистику гистограммы JSON-словарём
+    void PrintTo(format::Writer& output) const;
+
+    static size_t GetBucketIndex(uint64_t value);
+    static uint64_t GetBucketLowerBound(size_t index);
+    static uint64_t GetBucketUpperBound(size_t index);
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets_{};
+    std::atomic<uint64_t> count_ = 0;
+    std::atomic<uint64_t> sum_ = 0;
+    std::atomic<uint64_t> min_ = UINT64_MAX;
+    std::atomic<uint64_t> max_ = 0;
+};
+
+// Включает сбор метрик запросов. По умолчанию сбор выключен
+void Enable();
+bool IsEnabled();
+
+// Учитывает обработанный запрос типа type; not_found - ответ содержит error_message
+void Record(std::string_view type, uint64_t latency_ns, bool not_found);
+
+// Выводит метрики по типам запросов (Bus, Stop, Route, Map, MapTile, RouteMap, Other) одним JSON-словарём без переводов строк
+void PrintReport(format::Writer& output);
+
+}  // namespace request_metrics
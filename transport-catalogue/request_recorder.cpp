@@ -0,0 +1,28 @@
+#include "request_recorder.h"
+
+namespace request_recorder {
+
+using namespace std::literals;
+
+RequestRecorder::RequestRecorder(std::ostream& output)
+    : writer_(output) {
+}
+
+void RequestRecorder::Record(std::chrono::steady_clock::time_point arrival, std::string_view request, std::string_view response) {
+    const std::chrono::duration<double> time = arrival - start_;
+    std::lock_guard lock(mutex_);
+    writer_ << "{\"time\":"sv;
+    writer_.WriteDouble(time.count(), 15);
+    writer_ << ",\"request\":\""sv;
+    writer_.WriteJsonEscaped(request);
+    writer_ << "\",\"response\":\""sv;
+    writer_.WriteJsonEscaped(response);
+    writer_ << "\"}\n"sv;
+}
+
+void RequestRecorder::Flush() {
+    std::lock_guard lock(mutex_);
+    writer_.Flush();
+}
+
+}  // namespace request_recorder
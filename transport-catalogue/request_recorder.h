@@ -0,0 +1,39 @@
+#pragma once
+
+#include "format.h"
+
+#include <chrono>
+#include <iosfwd>
+#include <mutex>
+#include <string_view>
+
+namespace request_recorder {
+
+/*
+ * Запись потока запросов режима JSON Lines для последующего воспроизведения.
+ * Каждая запись - строка JSON {"time": секунды от начала записи до поступления запроса, "request": "...", "response": "..."},
+ * где запрос и ответ сохранены строками в том виде, в каком были получены и отправлены.
+ * Запись потокобезопасна; порядок строк совпадает с порядком завершения обработки запросов, поэтому
+ * при параллельной обработке время в соседних строках может убывать
+ */
+class RequestRecorder {
+public:
+    explicit RequestRecorder(std::ostream& output);
+
+    RequestRecorder(const RequestRecorder&) = delete;
+    RequestRecorder& operator=(const RequestRecorder&) = delete;
+
+    // arrival - момент поступления запроса, а не завершения его обработки, чтобы при воспроизведении
+    // интервалы между запросами не включали время их обработки
+    void Record(std::chrono::steady_clock::time_point arrival, std::string_view request, std::string_view response);
+
+    // Сбрасывает накопленные записи в поток
+    void Flush();
+
+private:
+    std::mutex mutex_;
+    format::Writer writer_;
+    const std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+};
+
+}  // namespace request_recorder
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace socket_client {
+
+// Подключается к серверу запросов по Unix domain сокету или, если путь пуст, по TCP к 127.0.0.1:tcp_port.
+// При ошибке выбрасывает std::system_error
+int Connect(const std::string& unix_socket_path, uint16_t tcp_port);
+
+// Отправляет data целиком; false - соединение разорвано
+bool SendAll(int fd, std::string_view data);
+
+// Читает из сокета одну строку ответа без перевода строки; buffer хранит данные, прочитанные сверх неё
+bool ReadLine(int fd, std::string& buffer, std::string& line);
+
+}  // namespace socket_client
@@ -6,30 +6,58 @@ namespace svg {
 
     namespace {
 
-        void RenderColor(std::ostream& out, std::monostate) {
-            out << "none"s;
+        void RenderColor(format::Writer& out, std::monostate) {
+            out << "none"sv;
         }
 
-        void RenderColor(std::ostream& out, const std::string& value) {
+        void RenderColor(format::Writer& out, const std::string& value) {
             out << value;
         }
 
-        void RenderColor(std::ostream& out, Rgb rgb) {
+        void RenderColor(format::Writer& out, Rgb rgb) {
             out << "rgb("sv << static_cast<int>(rgb.red)  //
                 << ',' << static_cast<int>(rgb.green)     //
                 << ',' << static_cast<int>(rgb.blue) << ')';
         }
 
-        void RenderColor(std::ostream& out, Rgba rgba) {
+        void RenderColor(format::Writer& out, Rgba rgba) {
             out << "rgba("sv << static_cast<int>(rgba.red)  //
                 << ',' << static_cast<int>(rgba.green)      //
                 << ',' << static_cast<int>(rgba.blue)       //
                 << ',' << rgba.opacity << ')';
         }
 
+        std::string_view ToStringView(StrokeLineCap value) {
+            switch (value) {
+                case StrokeLineCap::BUTT:
+                    return "butt"sv;
+                case StrokeLineCap::ROUND:
+                    return "round"sv;
+                case StrokeLineCap::SQUARE:
+                    return "square"sv;
+            }
+            return {};
+        }
+
+        std::string_view ToStringView(StrokeLineJoin value) {
+            switch (value) {
+                case StrokeLineJoin::ARCS:
+                    return "arcs"sv;
+                case StrokeLineJoin::BEVEL:
+                    return "bevel"sv;
+                case StrokeLineJoin::MITER:
+                    return "miter"sv;
+                case StrokeLineJoin::MITER_CLIP:
+                    return "miter-clip"sv;
+                case StrokeLineJoin::ROUND:
+                    return "round"sv;
+            }
+            return {};
+        }
+
     }  // namespace
 
-    std::ostream& operator<<(std::ostream& out, const Color& color) {
+    format::Writer& operator<<(format::Writer& out, const Color& color) {
         std::visit(
                 [&out](const auto& value) {
                     RenderColor(out, value);
@@ -38,42 +66,29 @@ namespace svg {
         return out;
     }
 
-    std::ostream& operator<<(std::ostream& out, StrokeLineCap value) {
-        std::string_view sv;
-        switch (value) {
-            case StrokeLineCap::BUTT:
-                sv = "butt"sv;
-                break;
-            case StrokeLineCap::ROUND:
-                sv = "round"sv;
-                break;
-            case StrokeLineCap::SQUARE:
-                sv = "square"sv;
-                break;
+    std::ostream& operator<<(std::ostream& out, const Color& color) {
+        std::string text;
+        {
+            format::Writer writer(text);
+            writer << color;
         }
-        return out << sv;
+        return out << text;
+    }
+
+    format::Writer& operator<<(format::Writer& out, StrokeLineCap value) {
+        return out << ToStringView(value);
+    }
+
+    std::ostream& operator<<(std::ostream& out, StrokeLineCap value) {
+        return out << ToStringView(value);
+    }
+
+    format::Writer& operator<<(format::Writer& out, StrokeLineJoin value) {
+        return out << ToStringView(value);
     }
 
     std::ostream& operator<<(std::ostream& out, StrokeLineJoin value) {
-        std::string_view sv;
-        switch (value) {
-            case StrokeLineJoin::ARCS:
-                sv = "arcs"sv;
-                break;
-            case StrokeLineJoin::BEVEL:
-                sv = "bevel"sv;
-                break;
-            case StrokeLineJoin::MITER:
-                sv = "miter"sv;
-                break;
-            case StrokeLineJoin::MITER_CLIP:
-                sv = "miter-clip"sv;
-                break;
-            case StrokeLineJoin::ROUND:
-                sv = "round"sv;
-                break;
-        }
-        return out << sv;
+        return out << ToStringView(value);
     }
 
     void Object::Render(const RenderContext& context) const {
@@ -82,7 +97,7 @@ namespace svg {
         // Делегируем вывод тэга своим подклассам
         RenderObject(context);
 
-        context.out << std::endl;
+        context.out.Put('\n');
     }
 
 // Circle
@@ -177,7 +192,7 @@ namespace svg {
         if (!font_weight_.empty()) {
             RenderAttr(out, " font-weight"sv, font_weight_);
         }
-        out.put('>');
+        out.Put('>');
         detail::HtmlEncodeString(out, data_);
         out << "</text>"sv;
     }
@@ -185,43 +200,130 @@ namespace svg {
 // Document
 
     void Document::AddPtr(std::unique_ptr<Object>&& obj) {
+        elements_.push_back({ElementKind::OBJECT, static_cast<uint32_t>(objects_.size())});
         objects_.push_back(std::move(obj));
     }
 
+    void Document::AddShape(Circle&& circle) {
+        elements_.push_back({ElementKind::CIRCLE, static_cast<uint32_t>(circles_.size())});
+        circles_.push_back(std::move(circle));
+    }
+
+    void Document::AddShape(Polyline&& polyline) {
+        elements_.push_back({ElementKind::POLYLINE, static_cast<uint32_t>(polylines_.size())});
+        polylines_.push_back(std::move(polyline));
+    }
+
+    void Document::AddShape(Text&& text) {
+        elements_.push_back({ElementKind::TEXT, static_cast<uint32_t>(texts_.size())});
+        texts_.push_back(std::move(text));
+    }
+
+    // Повторяет Object::Render для конкретного типа: классы фигур final, поэтому RenderObject вызывается напрямую
+    template <typename Shape>
+    void Document::RenderShape(const RenderContext& context, const Shape& shape) {
+        context.RenderIndent();
+        shape.Shape::RenderObject(context);
+        context.out.Put('\n');
+    }
+
     void Document::Render(std::ostream& out) const {
-        out << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>"sv << std::endl;
-        out << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">"sv << std::endl;
+        format::Writer writer(out);
+        Render(writer);
+    }
+
+    void Document::Render(format::Writer& out) const {
+        out << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"sv;
+        out << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">\n"sv;
         RenderContext ctx{out, 2, 2};
-        for (const auto& obj : objects_) {
-            obj->Render(ctx);
+        for (const Element& element : elements_) {
+            switch (element.kind) {
+                case ElementKind::CIRCLE:
+                    RenderShape(ctx, circles_[element.index]);
+                    break;
+                case ElementKind::POLYLINE:
+                    RenderShape(ctx, polylines_[element.index]);
+                    break;
+                case ElementKind::TEXT:
+                    RenderShape(ctx, texts_[element.index]);
+                    break;
+                case ElementKind::OBJECT:
+                    objects_[element.index]->Render(ctx);
+                    break;
+            }
         }
         out << "</svg>"sv;
     }
 
+// DocumentFragment
+
+    void DocumentFragment::AddPtr(std::unique_ptr<Object>&& obj) {
+        Emit(*obj);
+    }
+
+    void DocumentFragment::AddShape(Circle&& circle) {
+        Emit(circle);
+    }
+
+    void DocumentFragment::AddShape(Polyline&& polyline) {
+        Emit(polyline);
+    }
+
+    void DocumentFragment::AddShape(Text&& text) {
+        Emit(text);
+    }
+
+    void DocumentFragment::Emit(const Object& object) {
+        format::Writer writer(text_);
+        object.Render(RenderContext{writer, 2, 2});
+    }
+
+// StreamDocument
+
+    StreamDocument::StreamDocument(Sink sink)
+        : sink_(std::move(sink)) {
+        sink_("<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">\n"sv);
+    }
+
+    void StreamDocument::AddPtr(std::unique_ptr<Object>&& obj) {
+        chunk_.AddPtr(std::move(obj));
+        EmitChunk();
+    }
+
+    void StreamDocument::AddShape(Circle&& circle) {
+        chunk_.AddShape(std::move(circle));
+        EmitChunk();
+    }
+
+    void StreamDocument::AddShape(Polyline&& polyline) {
+        chunk_.AddShape(std::move(polyline));
+        EmitChunk();
+    }
+
+    void StreamDocument::AddShape(Text&& text) {
+        chunk_.AddShape(std::move(text));
+        EmitChunk();
+    }
+
+    void StreamDocument::AddFragment(const DocumentFragment& fragment) {
+        if (!fragment.GetText().empty()) {
+            sink_(fragment.GetText());
+        }
+    }
+
+    void StreamDocument::Finish() {
+        sink_("</svg>"sv);
+    }
+
+    void StreamDocument::EmitChunk() {
+        sink_(chunk_.GetText());
+        chunk_.Clear();
+    }
+
     namespace detail {
 
-        void HtmlEncodeString(std::ostream& out, std::string_view sv) {
-            for (char c : sv) {
-                switch (c) {
-                    case '"':
-                        out << "&quot;"sv;
-                        break;
-                    case '<':
-                        out << "&lt;"sv;
-                        break;
-                    case '>':
-                        out << "&gt;"sv;
-                        break;
-                    case '&':
-                        out << "&amp;"sv;
-                        break;
-                    case '\'':
-                        out << "&apos;"sv;
-                        break;
-                    default:
-                        out.put(c);
-                }
-            }
+        void HtmlEncodeString(format::Writer& out, std::string_view sv) {
+            out.WriteHtmlEscaped(sv);
         }
 
     }  // namespace detail
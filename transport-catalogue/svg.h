@@ -1,11 +1,15 @@
 #pragma once
 
+#include "format.h"
+
 #include <cstdint>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <type_traits>
 #include <variant>
 #include <vector>
 
@@ -14,27 +18,27 @@ namespace svg {
     namespace detail {
 
         template <typename T>
-        inline void RenderValue(std::ostream& out, const T& value) {
+        inline void RenderValue(format::Writer& out, const T& value) {
             out << value;
         }
 
-        void HtmlEncodeString(std::ostream& out, std::string_view sv);
+        void HtmlEncodeString(format::Writer& out, std::string_view sv);
 
         template <>
-        inline void RenderValue<std::string>(std::ostream& out, const std::string& s) {
+        inline void RenderValue<std::string>(format::Writer& out, const std::string& s) {
             HtmlEncodeString(out, s);
         }
 
         template <typename AttrType>
-        inline void RenderAttr(std::ostream& out, std::string_view name, const AttrType& value) {
+        inline void RenderAttr(format::Writer& out, std::string_view name, const AttrType& value) {
             using namespace std::literals;
             out << name << "=\""sv;
             RenderValue(out, value);
-            out.put('"');
+            out.Put('"');
         }
 
         template <typename AttrType>
-        inline void RenderOptionalAttr(std::ostream& out, std::string_view name,
+        inline void RenderOptionalAttr(format::Writer& out, std::string_view name,
                                        const std::optional<AttrType>& value) {
             if (value) {
                 RenderAttr(out, name, *value);
@@ -84,17 +88,18 @@ namespace svg {
     inline const Color NoneColor{};
 
     std::ostream& operator<<(std::ostream& out, const Color& color);
+    format::Writer& operator<<(format::Writer& out, const Color& color);
 
 /*
  * Вспомогательная структура, хранящая контекст для вывода SVG-документа с отступами.
- * Хранит ссылку на поток вывода, текущее значение и шаг отступа при выводе элемента
+ * Хранит ссылку на буфер вывода, текущее значение и шаг отступа при выводе элемента
  */
     struct RenderContext {
-        RenderContext(std::ostream& out)
+        RenderContext(format::Writer& out)
                 : out(out) {
         }
 
-        RenderContext(std::ostream& out, int indent_step, int indent = 0)
+        RenderContext(format::Writer& out, int indent_step, int indent = 0)
                 : out(out)
                 , indent_step(indent_step)
                 , indent(indent) {
@@ -106,11 +111,11 @@ namespace svg {
 
         void RenderIndent() const {
             for (int i = 0; i < indent; ++i) {
-                out.put(' ');
+                out.Put(' ');
             }
         }
 
-        std::ostream& out;
+        format::Writer& out;
         int indent_step = 0;
         int indent = 0;
     };
@@ -137,6 +142,7 @@ namespace svg {
     };
 
     std::ostream& operator<<(std::ostream& out, StrokeLineCap value);
+    format::Writer& operator<<(format::Writer& out, StrokeLineCap value);
 
     enum class StrokeLineJoin {
         ARCS,
@@ -147,6 +153,7 @@ namespace svg {
     };
 
     std::ostream& operator<<(std::ostream& out, StrokeLineJoin value);
+    format::Writer& operator<<(format::Writer& out, StrokeLineJoin value);
 
     template <typename Owner>
     class PathProps {
@@ -175,7 +182,7 @@ namespace svg {
     protected:
         ~PathProps() = default;
 
-        void RenderAttrs(std::ostream& out) const {
+        void RenderAttrs(format::Writer& out) const {
             using detail::RenderOptionalAttr;
             using namespace std::literals;
             RenderOptionalAttr(out, "fill"sv, fill_color_);
@@ -205,12 +212,14 @@ namespace svg {
  * Унаследовавшись от PathProps<Circle>, мы "сообщаем" родителю,
  * что владельцем свойств является класс Circle
  */
-    class Circle : public Object, public PathProps<Circle> {
+    class Circle final : public Object, public PathProps<Circle> {
     public:
         Circle& SetCenter(Point center);
         Circle& SetRadius(double radius);
 
     private:
+        friend class Document;
+
         void RenderObject(const RenderContext& context) const override;
 
         Point center_;
@@ -221,12 +230,14 @@ namespace svg {
  * Класс Polyline моделирует элемент <polyline> для отображения ломаных линий
  * https://developer.mozilla.org/en-US/docs/Web/SVG/Element/polyline
  */
-    class Polyline : public Object, public PathProps<Polyline> {
+    class Polyline final : public Object, public PathProps<Polyline> {
     public:
         // Добавляет очередную вершину к ломаной линии
         Polyline& AddPoint(Point point);
 
     private:
+        friend class Document;
+
         void RenderObject(const RenderContext& context) const override;
         std::vector<Point> points_;
     };
@@ -235,7 +246,7 @@ namespace svg {
  * Класс Text моделирует элемент <text> для отображения текста
  * https://developer.mozilla.org/en-US/docs/Web/SVG/Element/text
  */
-    class Text : public Object, public PathProps<Text> {
+    class Text final : public Object, public PathProps<Text> {
     public:
         // Задаёт координаты опорной точки (атрибуты x и y)
         Text& SetPosition(Point pos);
@@ -256,6 +267,8 @@ namespace svg {
         Text& SetData(std::string data);
 
     private:
+        friend class Document;
+
         void RenderObject(const RenderContext& context) const override;
         Point position_;
         Point offset_;
@@ -270,14 +283,31 @@ namespace svg {
  */
     class ObjectContainer {
     public:
+        // Circle, Polyline и Text передаются контейнеру по значению через AddShape,
+        // остальные наследники Object - через AddPtr
         template <typename ObjectType>
         void Add(ObjectType object) {
-            AddPtr(std::make_unique<ObjectType>(std::move(object)));
+            if constexpr (std::is_same_v<ObjectType, Circle> || std::is_same_v<ObjectType, Polyline>
+                          || std::is_same_v<ObjectType, Text>) {
+                AddShape(std::move(object));
+            } else {
+                AddPtr(std::make_unique<ObjectType>(std::move(object)));
+            }
         }
 
         // Добавляет в svg-документ объект-наследник svg::Object
         virtual void AddPtr(std::unique_ptr<Object>&& obj) = 0;
 
+        virtual void AddShape(Circle&& circle) {
+            AddPtr(std::make_unique<Circle>(std::move(circle)));
+        }
+        virtual void AddShape(Polyline&& polyline) {
+            AddPtr(std::make_unique<Polyline>(std::move(polyline)));
+        }
+        virtual void AddShape(Text&& text) {
+            AddPtr(std::make_unique<Text>(std::move(text)));
+        }
+
     protected:
         // Интерфейс не предполагает полиморфное удаление
         // Поэтому деструктор объявлен защищённым невиртуальным
@@ -297,16 +327,106 @@ namespace svg {
         virtual ~Drawable() = default;
     };
 
+/*
+ * SVG-документ. Circle, Polyline и Text хранятся по значению в отдельных массивах
+ * и выводятся без виртуальных вызовов; порядок вывода задаёт общий список элементов.
+ * Прочие наследники Object хранятся по указателю
+ */
     class Document : public ObjectContainer {
     public:
         // Добавляет в svg-документ объект-наследник svg::Object
         void AddPtr(std::unique_ptr<Object>&& obj) override;
 
+        void AddShape(Circle&& circle) override;
+        void AddShape(Polyline&& polyline) override;
+        void AddShape(Text&& text) override;
+
         // Выводит в ostream svg-представление документа
         void Render(std::ostream& out) const;
+        void Render(format::Writer& out) const;
 
     private:
+        enum class ElementKind : uint8_t {
+            CIRCLE,
+            POLYLINE,
+            TEXT,
+            OBJECT,
+        };
+
+        struct Element {
+            ElementKind kind;
+            uint32_t index;
+        };
+
+        template <typename Shape>
+        static void RenderShape(const RenderContext& context, const Shape& shape);
+
+        std::vector<Element> elements_;
+        std::vector<Circle> circles_;
+        std::vector<Polyline> polylines_;
+        std::vector<Text> texts_;
         std::vector<std::unique_ptr<Object>> objects_;
     };
 
+/*
+ * Часть SVG-документа без заголовка: элементы выводятся в строку сразу при добавлении,
+ * с теми же отступами, что и в документе. Части можно отрисовывать независимо,
+ * например в разных потоках, и затем передать в StreamDocument по порядку
+ */
+    class DocumentFragment : public ObjectContainer {
+    public:
+        void AddPtr(std::unique_ptr<Object>&& obj) override;
+
+        void AddShape(Circle&& circle) override;
+        void AddShape(Polyline&& polyline) override;
+        void AddShape(Text&& text) override;
+
+        const std::string& GetText() const {
+            return text_;
+        }
+
+        // Удаляет выведенные элементы, сохраняя выделенную под текст память
+        void Clear() {
+            text_.clear();
+        }
+
+    private:
+        void Emit(const Object& object);
+
+        std::string text_;
+    };
+
+/*
+ * Потоковый SVG-документ: каждый добавленный элемент сразу выводится в приёмник и не хранится.
+ * Приёмник получает текст документа фрагментами - заголовок, по одному элементу и закрывающий тэг,
+ * поэтому память не зависит от числа элементов. Вывод совпадает с выводом Document
+ */
+    class StreamDocument : public ObjectContainer {
+    public:
+        using Sink = std::function<void(std::string_view)>;
+
+        // Передаёт приёмнику заголовок документа
+        explicit StreamDocument(Sink sink);
+
+        void AddPtr(std::unique_ptr<Object>&& obj) override;
+
+        void AddShape(Circle&& circle) override;
+        void AddShape(Polyline&& polyline) override;
+        void AddShape(Text&& text) override;
+
+        // Передаёт приёмнику элементы части документа одним фрагментом
+        void AddFragment(const DocumentFragment& fragment);
+
+        // Передаёт приёмнику закрывающий тэг; после вызова элементы добавлять нельзя
+        void Finish();
+
+    private:
+        // Передаёт приёмнику накопленный элемент
+        void EmitChunk();
+
+        Sink sink_;
+        // Текст очередного элемента; буфер переиспользуется между элементами
+        DocumentFragment chunk_;
+    };
+
 }  // namespace svg
\ No newline at end of file
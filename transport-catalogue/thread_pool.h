@@ -0,0 +1,43 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace thread_pool {
+
+/*
+ * Пул с фиксированным числом потоков, выполняющих задачи в порядке поступления.
+ * Деструктор дожидается выполнения всех поставленных задач
+ */
+class ThreadPool {
+public:
+    // При thread_count == 0 число потоков равно числу ядер
+    explicit ThreadPool(size_t thread_count = 0);
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool();
+
+    void Submit(std::function<void()> task);
+
+    size_t GetThreadCount() const {
+        return threads_.size();
+    }
+
+private:
+    void WorkerLoop();
+
+    std::mutex mutex_;
+    std::condition_variable tasks_cv_;
+    std::deque<std::function<void()>> tasks_;
+    bool stopping_ = false;
+    std::vector<std::thread> threads_;
+};
+
+}  // namespace thread_pool
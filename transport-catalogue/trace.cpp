@@ -0,0 +1,134 @@
+#include "trace.h"
+#include "format.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace trace {
+
+using namespace std::literals;
+
+namespace {
+
+struct Event {
+    const char* category;
+    const char* name;
+    std::string detail;
+    int64_t start_ns;
+    int64_t duration_ns;
+};
+
+// Буфер одного потока. Мьютекс захватывается владельцем без конкуренции и нужен только для вывода трассы
+struct ThreadBuffer {
+    int thread_id = 0;
+    std::mutex mutex;
+    std::vector<Event> events;
+};
+
+std::atomic<bool> enabled = false;
+const auto epoch = std::chrono::steady_clock::now();
+
+// Буферы переживают свои потоки: интервалы рабочих потоков выводятся после их завершения
+std::mutex buffers_mutex;
+std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+
+int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+ThreadBuffer& GetThreadBuffer() {
+    thread_local const std::shared_ptr<ThreadBuffer> buffer = [] {
+        auto new_buffer = std::make_shared<ThreadBuffer>();
+        std::lock_guard lock(buffers_mutex);
+        new_buffer->thread_id = static_cast<int>(buffers.size()) + 1;
+        buffers.push_back(new_buffer);
+        return new_buffer;
+    }();
+    return *buffer;
+}
+
+// trace_event ожидает время в микросекундах; дробная часть сохраняет точность до наносекунды
+void WriteMicroseconds(format::Writer& output, int64_t ns) {
+    output << ns / 1000 << '.';
+    const int64_t fraction = ns % 1000;
+    if (fraction < 100) {
+        output.Put('0');
+    }
+    if (fraction < 10) {
+        output.Put('0');
+    }
+    output << fraction;
+}
+
+}  // namespace
+
+void Enable() {
+    enabled = true;
+}
+
+bool IsEnabled() {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+void WriteTrace(std::ostream& output) {
+    format::Writer writer(output);
+    writer << "{\"traceEvents\":["sv;
+    bool first = true;
+    std::lock_guard buffers_lock(buffers_mutex);
+    for (const auto& buffer : buffers) {
+        std::lock_guard lock(buffer->mutex);
+        for (const Event& event : buffer->events) {
+            if (!first) {
+                writer.Put(',');
+            }
+            first = false;
+            writer << "\n{\"name\":\""sv;
+            writer.WriteJsonEscaped(event.name);
+            writer << "\",\"cat\":\""sv;
+            writer.WriteJsonEscaped(event.category);
+            writer << "\",\"ph\":\"X\",\"ts\":"sv;
+            WriteMicroseconds(writer, event.start_ns);
+            writer << ",\"dur\":"sv;
+            WriteMicroseconds(writer, event.duration_ns);
+            writer << ",\"pid\":1,\"tid\":"sv << buffer->thread_id;
+            if (!event.detail.empty()) {
+                writer << ",\"args\":{\"detail\":\""sv;
+                writer.WriteJsonEscaped(event.detail);
+                writer << "\"}"sv;
+            }
+            writer.Put('}');
+        }
+    }
+    writer << "\n],\"displayTimeUnit\":\"ms\"}\n"sv;
+}
+
+Span::Span(const char* category, const char* name)
+    : category_(category)
+    , name_(name) {
+    if (IsEnabled()) {
+        active_ = true;
+        start_ns_ = NowNs();
+    }
+}
+
+Span::Span(const char* category, const char* name, std::string_view detail)
+    : Span(category, name) {
+    if (active_) {
+        detail_ = detail;
+    }
+}
+
+Span::~Span() {
+    if (!active_) {
+        return;
+    }
+    const int64_t end_ns = NowNs();
+    ThreadBuffer& buffer = GetThreadBuffer();
+    std::lock_guard lock(buffer.mutex);
+    buffer.events.push_back({category_, name_, std::move(detail_), start_ns_, end_ns - start_ns_});
+}
+
+}  // namespace trace
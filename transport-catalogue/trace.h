@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+
+/*
+ * Запись интервалов (span) выполнения в формате Chrome trace_event для просмотра
+ * в chrome://tracing или Perfetto.
+ * Инструментация пишется макросом TRACE_SPAN(category, name[, detail]) и компилируется,
+ * только если определён TRANSPORT_CATALOGUE_TRACE; иначе макрос раскрывается в пустую
+ * инструкцию и не вычисляет аргументы. Собранная с ним программа пишет интервалы
+ * только после вызова trace::Enable
+ */
+#ifdef TRANSPORT_CATALOGUE_TRACE
+#define TRACE_CONCAT_IMPL(lhs, rhs) lhs##rhs
+#define TRACE_CONCAT(lhs, rhs) TRACE_CONCAT_IMPL(lhs, rhs)
+#define TRACE_SPAN(...) ::trace::Span TRACE_CONCAT(trace_span_, __LINE__)(__VA_ARGS__)
+#else
+#define TRACE_SPAN(...) static_cast<void>(0)
+#endif
+
+namespace trace {
+
+#ifdef TRANSPORT_CATALOGUE_TRACE
+inline constexpr bool COMPILED_IN = true;
+#else
+inline constexpr bool COMPILED_IN = false;
+#endif
+
+// Включает запись интервалов. По умолчанию запись выключена
+void Enable();
+bool IsEnabled();
+
+// Выводит интервалы всех потоков JSON-объектом {"traceEvents": [...]}
+void WriteTrace(std::ostream& output);
+
+/*
+ * Интервал от создания объекта до его разрушения.
+ * category и name должны жить до вывода трассы (обычно это строковые литералы),
+ * detail копируется и выводится в args. Каждый поток пишет в собственный буфер
+ */
+class Span {
+public:
+    Span(const char* category, const char* name);
+    Span(const char* category, const char* name, std::string_view detail);
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+    ~Span();
+
+private:
+    const char* category_;
+    const char* name_;
+    std::string detail_;
+    bool active_ = false;
+    int64_t start_ns_ = 0;
+};
+
+}  // namespace trace
@@ -1,4 +1,5 @@
 #include "transport_catalogue.h"
+#include "profiler.h"
 
 namespace transport_catalogue {
 
@@ -11,6 +12,7 @@ void TransportCatalogue::AddBus(const Bus& bus) {
     buses_.emplace_back(bus);
     busname_to_bus_[buses_.back().name] = &buses_.back();
     
+    profiler::ScopedSubsystem subsystem(profiler::Subsystem::StopToBuses);
     for (const auto& stop : buses_.back().stops) {
         stop_to_buses_[stop].emplace(buses_.back().name);
     }
@@ -93,6 +95,7 @@ std::vector<std::string_view> TransportCatalogue::GetBusesByStop(std::string_vie
 }
 
 void TransportCatalogue::AddStopsDistance(const Stop* from, const Stop* to, int di) {
+    profiler::ScopedSubsystem subsystem(profiler::Subsystem::StopDistances);
     stops_di_[{from, to}] = di;
     if (stops_di_.find({to, from}) == stops_di_.end()) {
         stops_di_[{to, from}] = di;
@@ -1,4 +1,6 @@
 #include "transport_router.h"
+#include "profiler.h"
+#include "trace.h"
 
 namespace transport_catalogue {
 
@@ -7,8 +9,16 @@ TransportRouter::TransportRouter(int bus_wait_time, double bus_velocity)
 }
 
 void TransportRouter::BuildGraph(const TransportCatalogue& catalogue) {
-    InitializeStops(catalogue);
-    AddBusEdges(catalogue);
+    {
+        profiler::ScopedPhase phase("router.build_graph");
+        TRACE_SPAN("build", "router.build_graph");
+        profiler::ScopedSubsystem subsystem(profiler::Subsystem::GraphEdges);
+        InitializeStops(catalogue);
+        AddBusEdges(catalogue);
+    }
+    profiler::ScopedPhase phase("router.build_all_pairs");
+    TRACE_SPAN("build", "router.build_all_pairs");
+    profiler::ScopedSubsystem subsystem(profiler::Subsystem::RouterMatrix);
     router_ = std::make_unique<graph::Router<double>>(graph_);
 }
 
@@ -37,6 +47,7 @@ void TransportRouter::AddBusEdges(const TransportCatalogue& catalogue) {
     const auto& buses = catalogue.GetBusNameToBusMap();
 
     for (const auto& [bus_name, bus_info] : buses) {
+        TRACE_SPAN("build", "AddBusEdges", bus_name);
         const auto& stops = bus_info->stops;
         size_t stop_count = stops.size();
 